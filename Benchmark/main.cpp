@@ -0,0 +1,436 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Algorithms.h"
+#include "RandomExpression.h"
+
+// Benchmark [--corpus file] [--random nodes]... [--repetitions n] [--warmup n] [--arena] [--json file]
+// Times every stage of differentiating each expression of the corpus (corpus.txt by default) with
+// respect to x, and reports the mean, median and 99th percentile time of each stage per section
+// of the corpus and overall. With --json the report is written to file (or stdout if '-') as JSON.
+// Each --random adds a section of generated expressions of that many nodes (see RandomExpression.h),
+// and without --corpus skips the corpus. With --arena the whole of Differentiate is also timed with
+// its nodes on the heap and in an ExpressionArena, reporting the nodes each allocates.
+
+namespace
+{
+	namespace Stage
+	{
+		enum : size_t { Tokenize, Build, Derivative, Simplify, Print, Total, Count };
+	}
+
+	const char* const stageNames[Stage::Count] = { "tokenize", "build", "derivative", "simplify", "print", "total" };
+
+	using Clock = std::chrono::steady_clock;
+
+	// A sample shorter than this would mostly measure the clock, so fast stages are repeated
+	// until a sample takes at least this long and the time is divided by the repetitions
+	constexpr double minimumSampleNanoseconds = 2000;
+
+	struct Options
+	{
+		std::string corpus = "corpus.txt";
+		size_t repetitions = 200;
+		size_t warmup = 20;
+		std::string json;
+		std::vector<size_t> randomSizes;
+		bool readCorpus = true;
+		bool arena = false;
+	};
+
+	// Totals over the expressions of a section, of one call to Differentiate each
+	struct ArenaComparison
+	{
+		double heapNanoseconds = 0;
+		double arenaNanoseconds = 0;
+		size_t heapNodes = 0;
+		size_t arenaNodes = 0;
+		size_t arenaBytes = 0;
+
+		ArenaComparison& operator+=(const ArenaComparison& other)
+		{
+			heapNanoseconds += other.heapNanoseconds;
+			arenaNanoseconds += other.arenaNanoseconds;
+			heapNodes += other.heapNodes;
+			arenaNodes += other.arenaNodes;
+			arenaBytes += other.arenaBytes;
+			return *this;
+		}
+	};
+
+	constexpr size_t randomExpressionsPerSection = 8;
+
+	struct Section
+	{
+		std::string name;
+		std::vector<std::string> expressions;
+		// The time in nanoseconds of each run of a stage over every expression of the section
+		std::array<std::vector<double>, Stage::Count> samples;
+		ArenaComparison arena;
+	};
+
+	struct Summary
+	{
+		double mean;
+		double p50;
+		double p99;
+	};
+
+	// Runs stage batch times and returns the result of the last run, along with the mean time of a run
+	template <typename F>
+	auto Time(F stage, size_t batch, double& nanoseconds)
+	{
+		const auto start = Clock::now();
+
+		for (size_t i = 1; i < batch; i++)
+			stage();
+
+		auto result = stage();
+		nanoseconds = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / batch;
+
+		return result;
+	}
+
+	// One run of every stage over expression, each stage repeated as often as batches says
+	std::array<double, Stage::Count> Run(const std::string& expression, const std::array<size_t, Stage::Count>& batches)
+	{
+		std::array<double, Stage::Count> times{};
+
+		auto tokens = Time([&] { return Tokenize(expression); }, batches[Stage::Tokenize], times[Stage::Tokenize]);
+		auto expr = Time([&] { return BuildExpression(tokens); }, batches[Stage::Build], times[Stage::Build]);
+		auto derivative = Time([&] { return expr->Derivative('x'); }, batches[Stage::Derivative], times[Stage::Derivative]);
+		auto simplified = Time([&] { return derivative->Simplified(); }, batches[Stage::Simplify], times[Stage::Simplify]);
+		Time([&] { return simplified->Print(); }, batches[Stage::Print], times[Stage::Print]);
+
+		for (size_t stage = 0; stage < Stage::Total; stage++)
+			times[Stage::Total] += times[stage];
+
+		return times;
+	}
+
+	// The mean time of Differentiate over repetitions with its nodes on the heap and then in an
+	// arena, as in the interactive program, and the nodes each way allocates
+	ArenaComparison CompareArena(const std::string& expression, ExpressionArena& arena, size_t repetitions)
+	{
+		ArenaComparison comparison;
+
+		auto heapAllocations = ExpressionArena::HeapAllocations();
+		Differentiate(expression, 'x');
+		comparison.heapNodes = ExpressionArena::HeapAllocations() - heapAllocations;
+
+		Differentiate(expression, 'x', arena);
+		comparison.arenaNodes = arena.Allocations();
+		comparison.arenaBytes = arena.BytesUsed();
+
+		const auto batch = std::max<size_t>(repetitions, 1);
+		Time([&] { return Differentiate(expression, 'x'); }, batch, comparison.heapNanoseconds);
+		Time([&] { return Differentiate(expression, 'x', arena); }, batch, comparison.arenaNanoseconds);
+
+		return comparison;
+	}
+
+	// Nearest rank percentile, sorts samples
+	Summary Summarize(std::vector<double>& samples)
+	{
+		if (samples.empty()) return { 0, 0, 0 };
+
+		std::sort(samples.begin(), samples.end());
+
+		auto percentile = [&](double p) { return samples[static_cast<size_t>(std::ceil(p * samples.size())) - 1]; };
+
+		double sum = 0;
+
+		for (auto sample : samples)
+			sum += sample;
+
+		return { sum / samples.size(), percentile(0.5), percentile(0.99) };
+	}
+
+	std::vector<Section> ReadCorpus(std::istream& in)
+	{
+		std::vector<Section> sections;
+		std::string line;
+
+		while (std::getline(in, line))
+		{
+			if (!line.empty() && line.back() == '\r') line.pop_back();
+
+			if (line.empty() || line[0] == '#') continue;
+
+			if (line[0] == '[' && line.back() == ']')
+				sections.push_back({ line.substr(1, line.size() - 2), {}, {} });
+			else
+			{
+				if (sections.empty()) sections.push_back({ "default", {}, {} });
+
+				sections.back().expressions.push_back(line);
+			}
+		}
+
+		return sections;
+	}
+
+	// As a JSON string, only quotes and backslashes need escaping in a path or section name
+	std::string Quoted(const std::string& text)
+	{
+		std::string result = "\"";
+
+		for (auto c : text)
+		{
+			if (c == '"' || c == '\\') result += '\\';
+			result += c;
+		}
+
+		return result + '"';
+	}
+
+	void WriteText(std::ostream& out, const std::vector<Section>& sections, std::vector<Summary> (&summaries)[Stage::Count])
+	{
+		out << std::left << std::setw(16) << "section" << std::setw(12) << "stage" << std::right
+			<< std::setw(12) << "mean ns" << std::setw(12) << "p50 ns" << std::setw(12) << "p99 ns" << '\n'
+			<< std::fixed << std::setprecision(0);
+
+		for (size_t i = 0; i < sections.size(); i++)
+			for (size_t stage = 0; stage < Stage::Count; stage++)
+			{
+				const auto& summary = summaries[stage][i];
+
+				out << std::left << std::setw(16) << (stage == 0 ? sections[i].name : "") << std::setw(12) << stageNames[stage] << std::right
+					<< std::setw(12) << summary.mean << std::setw(12) << summary.p50 << std::setw(12) << summary.p99 << '\n';
+			}
+	}
+
+	void WriteArenaText(std::ostream& out, const std::vector<Section>& sections)
+	{
+		out << '\n' << std::left << std::setw(16) << "section" << std::right << std::setw(12) << "heap ns" << std::setw(12) << "arena ns"
+			<< std::setw(12) << "heap nodes" << std::setw(12) << "arena nodes" << std::setw(12) << "arena bytes" << '\n'
+			<< std::fixed << std::setprecision(0);
+
+		// Per expression, so sections of different sizes compare
+		for (const auto& section : sections)
+		{
+			const double count = std::max<size_t>(section.expressions.size(), 1);
+			const auto& arena = section.arena;
+
+			out << std::left << std::setw(16) << section.name << std::right
+				<< std::setw(12) << arena.heapNanoseconds / count << std::setw(12) << arena.arenaNanoseconds / count
+				<< std::setw(12) << arena.heapNodes / count << std::setw(12) << arena.arenaNodes / count
+				<< std::setw(12) << arena.arenaBytes / count << '\n';
+		}
+	}
+
+	void WriteJson(std::ostream& out, const Options& options, const std::vector<Section>& sections, std::vector<Summary> (&summaries)[Stage::Count])
+	{
+		auto writeSection = [&](size_t i, const char* indent)
+		{
+			out << indent << "{\n"
+				<< indent << "  \"name\": " << Quoted(sections[i].name) << ",\n"
+				<< indent << "  \"expressions\": " << sections[i].expressions.size() << ",\n"
+				<< indent << "  \"stages\": {\n";
+
+			for (size_t stage = 0; stage < Stage::Count; stage++)
+			{
+				const auto& summary = summaries[stage][i];
+
+				out << indent << "    \"" << stageNames[stage] << "\": { \"mean_ns\": " << summary.mean
+					<< ", \"p50_ns\": " << summary.p50 << ", \"p99_ns\": " << summary.p99 << " }"
+					<< (stage + 1 < Stage::Count ? ",\n" : "\n");
+			}
+
+			out << indent << "  }";
+
+			if (options.arena)
+			{
+				// Per expression, as in the table
+				const double count = std::max<size_t>(sections[i].expressions.size(), 1);
+				const auto& arena = sections[i].arena;
+
+				out << ",\n" << indent << "  \"arena\": { \"heap_ns\": " << arena.heapNanoseconds / count
+					<< ", \"arena_ns\": " << arena.arenaNanoseconds / count
+					<< ", \"heap_nodes\": " << arena.heapNodes / count
+					<< ", \"arena_nodes\": " << arena.arenaNodes / count
+					<< ", \"arena_bytes\": " << arena.arenaBytes / count << " }";
+			}
+
+			out << "\n" << indent << "}";
+		};
+
+		out << std::fixed << std::setprecision(1)
+			<< "{\n"
+			<< "  \"corpus\": " << (options.readCorpus ? Quoted(options.corpus) : "null") << ",\n"
+			<< "  \"repetitions\": " << options.repetitions << ",\n"
+			<< "  \"warmup\": " << options.warmup << ",\n"
+			<< "  \"sections\": [\n";
+
+		// The last entry is the whole corpus
+		for (size_t i = 0; i + 1 < sections.size(); i++)
+		{
+			writeSection(i, "    ");
+			out << (i + 2 < sections.size() ? ",\n" : "\n");
+		}
+
+		out << "  ],\n  \"overall\":\n";
+		writeSection(sections.size() - 1, "  ");
+		out << "\n}\n";
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	Options options;
+	bool corpusGiven = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--corpus" && hasValue)
+		{
+			options.corpus = argv[++i];
+			corpusGiven = true;
+		}
+		else if (arg == "--random" && hasValue)
+			options.randomSizes.push_back(std::stoul(argv[++i]));
+		else if (arg == "--repetitions" && hasValue)
+			options.repetitions = std::stoul(argv[++i]);
+		else if (arg == "--warmup" && hasValue)
+			options.warmup = std::stoul(argv[++i]);
+		else if (arg == "--arena")
+			options.arena = true;
+		else if (arg == "--json" && hasValue)
+			options.json = argv[++i];
+		else
+		{
+			std::cerr << "Usage: " << argv[0] << " [--corpus file] [--random nodes]... [--repetitions n] [--warmup n] [--arena] [--json file]\n";
+			return 2;
+		}
+	}
+
+	options.readCorpus = corpusGiven || options.randomSizes.empty();
+
+	std::vector<Section> sections;
+
+	if (options.readCorpus)
+	{
+		std::ifstream file(options.corpus);
+
+		if (!file)
+		{
+			std::cerr << "Cannot open '" << options.corpus << "'\n";
+			return 1;
+		}
+
+		sections = ReadCorpus(file);
+	}
+
+	for (auto size : options.randomSizes)
+	{
+		Section section{ "random " + std::to_string(size), {}, {} };
+
+		RandomExpressionOptions random;
+		random.size = size;
+		random.variables = 3;
+
+		for (unsigned seed = 0; seed < randomExpressionsPerSection; seed++)
+		{
+			random.seed = seed;
+			section.expressions.push_back(RandomExpression(random)->Print());
+		}
+
+		sections.push_back(std::move(section));
+	}
+
+	Section overall{ "overall", {}, {} };
+	ExpressionArena arena;
+
+	for (auto& section : sections)
+		for (auto& expression : section.expressions)
+		{
+			std::array<size_t, Stage::Count> batches;
+			batches.fill(1);
+
+			std::array<double, Stage::Count> warm{};
+
+			try
+			{
+				for (size_t i = 0; i < options.warmup; i++)
+				{
+					auto times = Run(expression, batches);
+
+					for (size_t stage = 0; stage < Stage::Count; stage++)
+						warm[stage] += times[stage] / options.warmup;
+				}
+
+				for (size_t stage = 0; options.warmup > 0 && stage < Stage::Count; stage++)
+					batches[stage] = std::max<size_t>(1, static_cast<size_t>(std::ceil(minimumSampleNanoseconds / std::max(warm[stage], 1.0))));
+
+				for (size_t i = 0; i < options.repetitions; i++)
+				{
+					auto times = Run(expression, batches);
+
+					for (size_t stage = 0; stage < Stage::Count; stage++)
+					{
+						section.samples[stage].push_back(times[stage]);
+						overall.samples[stage].push_back(times[stage]);
+					}
+				}
+
+				if (options.arena)
+				{
+					auto comparison = CompareArena(expression, arena, options.repetitions);
+					section.arena += comparison;
+					overall.arena += comparison;
+				}
+			}
+			catch (const std::exception& e)
+			{
+				std::cerr << "'" << expression << "': " << e.what() << '\n';
+				return 1;
+			}
+
+			overall.expressions.push_back(expression);
+		}
+
+	sections.push_back(std::move(overall));
+
+	std::vector<Summary> summaries[Stage::Count];
+
+	for (size_t stage = 0; stage < Stage::Count; stage++)
+		for (auto& section : sections)
+			summaries[stage].push_back(Summarize(section.samples[stage]));
+
+	if (options.json.empty())
+	{
+		WriteText(std::cout, sections, summaries);
+
+		if (options.arena)
+			WriteArenaText(std::cout, sections);
+
+		return 0;
+	}
+
+	if (options.json == "-")
+	{
+		WriteJson(std::cout, options, sections, summaries);
+		return 0;
+	}
+
+	std::ofstream json(options.json);
+
+	if (!json)
+	{
+		std::cerr << "Cannot open '" << options.json << "'\n";
+		return 1;
+	}
+
+	WriteJson(json, options, sections, summaries);
+	return 0;
+}
@@ -1,14 +1,175 @@
 #include "Algorithms.h"
-
+#include "BatchEvaluate.h"
+#include "DerivativeCache.h"
+#include "ExpressionDag.h"
+#include "Instrumentation.h"
+#include "Polynomial.h"
+#include "Rewrite.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <iterator>
 #include <random>
-#include <typeindex>
 
-std::string Differentiate(const std::string& str, char wrt)
+std::string Differentiate(const std::string& str, char wrt, OutputFormat format)
+{
+    auto tokens = SYMBOLDIFF_TIMED(Tokenize, Tokenize(str));
+    auto expression = SYMBOLDIFF_TIMED(Parse, BuildExpression(tokens));
+
+    // Polynomials are differentiated term by term without building a derivative tree at all.
+    // Their monomials share no operator nodes worth binding, so both formats print them as is.
+    if (auto polynomial = Polynomial::FromExpression(*expression))
+    {
+        auto derivative = SYMBOLDIFF_TIMED(Derivative, polynomial->Derivative(wrt));
+        return SYMBOLDIFF_TIMED(Print, derivative.Print());
+    }
+
+    auto derivative = SYMBOLDIFF_TIMED(Derivative, expression->Derivative(wrt));
+
+    // Nothing else holds the derivative, so unless Simplified() is being memoized it can be
+    // rewritten in place rather than copied first
+    if (!DerivativeCache::Current())
+        derivative = SYMBOLDIFF_TIMED(Simplify, RewriteEngine().Rewrite(std::move(derivative)));
+    else
+        derivative = SYMBOLDIFF_TIMED(Simplify, derivative->Simplified());
+
+    if (format == OutputFormat::CommonSubexpressions)
+        return SYMBOLDIFF_TIMED(Print, PrintWithCommonSubexpressions(*derivative));
+
+    return SYMBOLDIFF_TIMED(Print, derivative->Print());
+}
+
+std::string Differentiate(const std::string& str, char wrt, ExpressionArena& arena, OutputFormat format)
+{
+    // Reset up front rather than afterwards, so the nodes of a previous call that threw 
+    // are still reclaimed. All nodes of this call are destroyed before we return.
+    arena.Reset();
+
+    ExpressionArena::Scope scope(arena);
+    return Differentiate(str, wrt, format);
+}
+
+std::vector<std::unique_ptr<ExpressionBase>> Derivatives(const ExpressionBase& expr, char wrt, size_t order)
+{
+    std::vector<std::unique_ptr<ExpressionBase>> derivatives;
+    derivatives.reserve(order);
+
+    ExpressionDag dag;
+    auto id = dag.Import(expr);
+
+    for (size_t n = 0; n < order; n++)
+    {
+        // Simplifying between orders keeps each one small, and importing the result back
+        // interns it against the nodes of the orders before
+        auto derivative = RewriteEngine().Rewrite(dag.Export(dag.Derivative(id, wrt)));
+        id = dag.Import(*derivative);
+
+        derivatives.push_back(std::move(derivative));
+    }
+
+    return derivatives;
+}
+
+std::vector<std::string> DifferentiateUpTo(const std::string& str, char wrt, size_t order)
+{
+    auto expression = BuildExpression(Tokenize(str));
+
+    std::vector<std::string> derivatives;
+    derivatives.reserve(order);
+
+    if (auto polynomial = Polynomial::FromExpression(*expression))
+    {
+        for (size_t n = 0; n < order; n++)
+        {
+            polynomial = polynomial->Derivative(wrt);
+            derivatives.push_back(polynomial->Print());
+        }
+
+        return derivatives;
+    }
+
+    for (const auto& derivative : Derivatives(*expression, wrt, order))
+        derivatives.push_back(derivative->Print());
+
+    return derivatives;
+}
+
+std::vector<DifferentiateResult> DifferentiateBatch(const std::string* inputs, size_t count, char wrt, OutputFormat format)
+{
+    std::vector<DifferentiateResult> results(count);
+
+#ifdef SYMBOLDIFF_INSTRUMENTATION
+    auto caller = Instrumentation::Current();
+#endif
+
+    ThreadPool::Default().ParallelFor(count, [&](size_t i)
+    {
+        // Each thread reuses one arena for all the items it processes
+        thread_local ExpressionArena arena;
+
+#ifdef SYMBOLDIFF_INSTRUMENTATION
+        // Each input records into its own instrumentation, as the caller's is not
+        // current on the workers, which is then merged into the caller's
+        Instrumentation instrumentation;
+        Instrumentation::Scope scope(instrumentation);
+#endif
+
+        try
+        {
+            results[i].derivative = Differentiate(inputs[i], wrt, arena, format);
+        }
+        catch (const std::exception& e)
+        {
+            results[i].error = e.what();
+        }
+
+#ifdef SYMBOLDIFF_INSTRUMENTATION
+        results[i].counters = instrumentation.Totals();
+
+        if (caller)
+            caller->Add(results[i].counters);
+#endif
+    });
+
+    return results;
+}
+
+std::vector<DifferentiateResult> DifferentiateBatch(const std::vector<std::string>& inputs, char wrt, OutputFormat format)
+{
+    return DifferentiateBatch(inputs.data(), inputs.size(), wrt, format);
+}
+
+std::string PrintWithCommonSubexpressions(const ExpressionBase& expr)
 {
-    return BuildExpression(Tokenize(str))->Derivative(wrt)->Simplified()->Print();
+    ExpressionDag dag;
+    return dag.PrintWithTemporaries(dag.Import(expr));
 }
 
-bool ExpressionsNumericallyEqual(const ExpressionBase& lhs, const ExpressionBase& rhs)
+std::unique_ptr<ExpressionBase> LazyDerivativeOf(const ExpressionBase& expr, char wrt)
+{
+    LazyDerivative::Scope scope;
+    return expr.Derivative(wrt);
+}
+
+std::optional<double> DerivativeAt(const ExpressionBase& expr, char wrt, const std::unordered_map<char, double>& values)
+{
+    auto result = expr.EvaluateDual(values, { { wrt, 1.0 } });
+
+    if (result)
+        return result->tangent;
+    else
+        return std::nullopt;
+}
+
+std::optional<std::vector<double>> TaylorCoefficients(const ExpressionBase& expr, char wrt, const std::unordered_map<char, double>& values, size_t order)
+{
+    ExpressionDag dag;
+    return dag.TaylorCoefficients(dag.Import(expr), wrt, values, order);
+}
+
+bool ExpressionsNumericallyEqual(const ExpressionBase& lhs, const ExpressionBase& rhs, const NumericEqualityOptions& options)
 {
     // Exact match saves us work
     if (lhs == rhs) return true;
@@ -17,31 +178,79 @@ bool ExpressionsNumericallyEqual(const ExpressionBase& lhs, const ExpressionBase
     auto r = rhs.GetSetOfAllSubVariables();
 
     // Check expressions contain a the same set of variables
-    if (l != r) return false;
+    if (options.sameVariables && l != r) return false;
+
+    l.insert(r.begin(), r.end());
+
+    // Both sides share one slot order so they can be fed the same sample arrays
+    std::vector<char> variables(l.begin(), l.end());
+    std::sort(variables.begin(), variables.end());
+
+    auto left = CompiledExpression::Compile(lhs, variables);
+    auto right = CompiledExpression::Compile(rhs, variables);
+
+    constexpr size_t batchSize = 256;
+    const size_t batches = (options.samples + batchSize - 1) / batchSize;
+
+    std::atomic<bool> mismatch{ false };
+    // Samples where at least one side is defined, as agreeing only where neither is proves nothing
+    std::atomic<size_t> defined{ 0 };
 
-    for (int i = 0; i < 1000; i++)
+    ThreadPool::Default().ParallelFor(batches, [&](size_t batch)
     {
-        // Constant seed for determinism
-        std::default_random_engine eng(0);
+        if (mismatch) return;
+
+        const auto begin = batch * batchSize;
+        const auto n = std::min(batchSize, options.samples - begin);
+
+        // Seeded per batch, so the points don't depend on which thread ran which batch
+        std::mt19937_64 eng(options.seed + batch);
 
         // Makes sense to have more numbers closer to zero for numerical stability
         std::normal_distribution<> distr(0, 10);
 
-        std::unordered_map<char, double> variables;
+        std::vector<double> samples(variables.size() * n);
+        std::vector<const double*> slots(variables.size());
+
+        for (size_t v = 0; v < variables.size(); v++)
+        {
+            slots[v] = samples.data() + v * n;
+
+            for (size_t i = 0; i < n; i++)
+                samples[v * n + i] = distr(eng);
+        }
 
-        for (const auto& var : l)
-            variables[var] = distr(eng);
+        std::vector<double> lhsValues(n), rhsValues(n);
+        EvaluateBatch(left, slots.data(), lhsValues.data(), n);
+        EvaluateBatch(right, slots.data(), rhsValues.data(), n);
 
-        auto approximatelyEqual = [](double a, double b, double epsilon)
+        auto approximatelyEqual = [&](double a, double b)
         {
-            return abs(a - b) <= (std::max(abs(a), abs(b)) * epsilon);
+            // Points where both sides are undefined (e.g a negative number to a fractional power)
+            // tell us nothing, and equal infinities would otherwise give inf - inf = NaN
+            if (a == b || (std::isnan(a) && std::isnan(b))) return true;
+
+            return std::abs(a - b) <= std::max(std::max(std::abs(a), std::abs(b)) * options.tolerance, options.absoluteTolerance);
         };
 
-        if (!approximatelyEqual(*lhs.Evaluate(variables), *rhs.Evaluate(variables), 0.001))
-            return false;
-    }
+        size_t batchDefined = 0;
+
+        for (size_t i = 0; i < n; i++)
+        {
+            if (!approximatelyEqual(lhsValues[i], rhsValues[i]))
+            {
+                mismatch = true;
+                return;
+            }
 
-    return true;
+            if (!std::isnan(lhsValues[i]) || !std::isnan(rhsValues[i]))
+                batchDefined++;
+        }
+
+        defined += batchDefined;
+    });
+
+    return !mismatch && defined > 0;
 }
 
 // EVALUATE FUNCTIONS
@@ -131,163 +340,288 @@ std::optional<double> OperatorUnaryMinus::Evaluate(const std::unordered_map<char
         return std::nullopt;
 }
 
+std::optional<double> LazyDerivative::Evaluate(const std::unordered_map<char, double>& values) const
+{
+    if (!EvaluatesByDuals())
+        return Expanded().Evaluate(values);
+
+    auto result = GetOperand().EvaluateDual(values, { { GetVariable(), 1.0 } });
+
+    if (result)
+        return result->tangent;
+    else
+        return std::nullopt;
+}
+
+// DUAL EVALUATE FUNCTIONS
+//---------------------------------
+
+std::optional<Dual> Constant::EvaluateDual(const std::unordered_map<char, double>& /*values*/, const std::unordered_map<char, double>& /*direction*/) const
+{
+    return Dual{ value, 0 };
+}
+
+std::optional<Dual> Variable::EvaluateDual(const std::unordered_map<char, double>& values, const std::unordered_map<char, double>& direction) const
+{
+    auto pos = values.find(pronumeral);
+
+    if (pos == values.end())
+        return std::nullopt;
+
+    auto tangent = direction.find(pronumeral);
+
+    return Dual{ pos->second, tangent == direction.end() ? 0 : tangent->second };
+}
+
+std::optional<Dual> OperatorPlus::EvaluateDual(const std::unordered_map<char, double>& values, const std::unordered_map<char, double>& direction) const
+{
+    auto l = left->EvaluateDual(values, direction);
+    auto r = right->EvaluateDual(values, direction);
+
+    if (l && r)
+        return (*l) + (*r);
+    else
+        return std::nullopt;
+}
+
+std::optional<Dual> OperatorMinus::EvaluateDual(const std::unordered_map<char, double>& values, const std::unordered_map<char, double>& direction) const
+{
+    auto l = left->EvaluateDual(values, direction);
+    auto r = right->EvaluateDual(values, direction);
+
+    if (l && r)
+        return (*l) - (*r);
+    else
+        return std::nullopt;
+}
+
+std::optional<Dual> OperatorMultiply::EvaluateDual(const std::unordered_map<char, double>& values, const std::unordered_map<char, double>& direction) const
+{
+    auto l = left->EvaluateDual(values, direction);
+    auto r = right->EvaluateDual(values, direction);
+
+    if (l && r)
+        return (*l) * (*r);
+    else
+        return std::nullopt;
+}
+
+std::optional<Dual> OperatorDivide::EvaluateDual(const std::unordered_map<char, double>& values, const std::unordered_map<char, double>& direction) const
+{
+    auto l = left->EvaluateDual(values, direction);
+    auto r = right->EvaluateDual(values, direction);
+
+    if (l && r)
+        return (*l) / (*r);
+    else
+        return std::nullopt;
+}
+
+std::optional<Dual> OperatorExponent::EvaluateDual(const std::unordered_map<char, double>& values, const std::unordered_map<char, double>& direction) const
+{
+    auto l = left->EvaluateDual(values, direction);
+    auto r = right->EvaluateDual(values, direction);
+
+    if (l && r)
+        return Power(*l, *r);
+    else
+        return std::nullopt;
+}
+
+std::optional<Dual> OperatorUnaryMinus::EvaluateDual(const std::unordered_map<char, double>& values, const std::unordered_map<char, double>& direction) const
+{
+    auto r = right->EvaluateDual(values, direction);
+
+    if (r)
+        return -(*r);
+    else
+        return std::nullopt;
+}
+
+std::optional<Dual> LazyDerivative::EvaluateDual(const std::unordered_map<char, double>& values, const std::unordered_map<char, double>& direction) const
+{
+    // A derivative along a second direction needs the first one's structure
+    return Expanded().EvaluateDual(values, direction);
+}
+
 // PRINT FUNCTIONS
 //---------------------------------
 
 int ExpressionBase::Priority() const
 {
-    static const std::unordered_map<std::type_index, int> priority =
-    {
-        { typeid(Constant),             10 },
-        { typeid(Variable),             10 },
-        { typeid(OperatorPlus),         1 },
-        { typeid(OperatorMinus),        1 },
-        { typeid(OperatorMultiply),     2 },
-        { typeid(OperatorDivide),       2 },
-        { typeid(OperatorUnaryMinus),   3 },
-        { typeid(OperatorExponent),     4 },
-        
-    };
+    // A lazy derivative prints as its expansion
+    if (kind == ExpressionKind::LazyDerivative)
+        return static_cast<const LazyDerivative*>(this)->Expanded().Priority();
 
-    return priority.at(typeid(*this));
+    // Indexed by ExpressionKind, every kind but LazyDerivative, which is handled above
+    static constexpr int priority[] = { 10, 10, 1, 1, 2, 2, 4, 3 };
+    static_assert(std::size(priority) == static_cast<size_t>(ExpressionKind::LazyDerivative), "A priority for every printable kind");
+
+    // A negative constant prints with a leading minus, so it binds like one: (-2)^x, not -2^x
+    if (kind == ExpressionKind::Constant && std::signbit(static_cast<const Constant*>(this)->GetConstant()))
+        return priority[static_cast<size_t>(ExpressionKind::UnaryMinus)];
+
+    return priority[static_cast<size_t>(kind)];
 }
 
-std::string Constant::Print() const
+std::string ExpressionBase::Print() const
 {
-    auto PrintWithoutTrailingZeros = [](std::string str)
-    {
-        str.erase(str.find_last_not_of('0') + 1, std::string::npos);
-        str.erase(str.find_last_not_of('.') + 1, std::string::npos);
-        return str;
-    };
+    std::string str;
+    str.reserve(64);
 
-    return PrintWithoutTrailingZeros(std::to_string(value));
+    PrintTo(str);
+    return str;
 }
 
-std::string Variable::Print() const
+void Constant::Format(double value, std::string& out)
 {
-    return std::string(1, pronumeral);
+    // Fixed notation of the extremes: 309 integer digits, or 324 decimals of the smallest subnormal
+    char buffer[352];
+
+    auto result = std::to_chars(std::begin(buffer), std::end(buffer), value, std::chars_format::fixed);
+    out.append(buffer, result.ptr);
 }
 
-template <typename Derived>
-std::string BinaryOperator<Derived>::PrintBinary(const std::string& op, bool swap, bool leftAssosiative) const
+void Constant::PrintTo(std::string& out) const
 {
-    auto PrintExpr = [op, leftAssosiative](const ExpressionBase& l, const ExpressionBase& r, int priority)
-    {
-        std::string str = "";
-
-        if (leftAssosiative && l.Priority() < priority ||
-            !leftAssosiative && l.Priority() <= priority)
-            str += "(" + l.Print() + ")";
-        else
-            str += l.Print();
+    Format(value, out);
+}
 
-        str += op;
+void Variable::PrintTo(std::string& out) const
+{
+    out += pronumeral;
+}
 
-        if (leftAssosiative && r.Priority() <= priority ||
-            !leftAssosiative && r.Priority() < priority)
-            str += "(" + r.Print() + ")";
-        else
-            str += r.Print();
+template <typename Derived>
+void BinaryOperator<Derived>::PrintBinary(std::string& out, const char* op, bool swap, bool leftAssosiative) const
+{
+    const auto& l = swap ? *right : *left;
+    const auto& r = swap ? *left : *right;
+    const auto priority = this->Priority();
 
-        return str;
+    auto PrintOperand = [&out](const ExpressionBase& operand, bool parenthesize)
+    {
+        if (parenthesize) out += '(';
+        operand.PrintTo(out);
+        if (parenthesize) out += ')';
     };
 
-    if (swap)
-        return PrintExpr(*right, *left, this->Priority());
-    else
-        return PrintExpr(*left, *right, this->Priority());
+    PrintOperand(l, leftAssosiative ? l.Priority() < priority : l.Priority() <= priority);
+    out += op;
+    PrintOperand(r, leftAssosiative ? r.Priority() <= priority : r.Priority() < priority);
 }
 
-std::string OperatorPlus::Print() const
+void OperatorPlus::PrintTo(std::string& out) const
 {
-    return BinaryOperator::PrintBinary("+", false, true);
+    BinaryOperator::PrintBinary(out, "+", false, true);
 }
 
-std::string OperatorMinus::Print() const
+void OperatorMinus::PrintTo(std::string& out) const
 {
-    return BinaryOperator::PrintBinary("-", false, true);
+    BinaryOperator::PrintBinary(out, "-", false, true);
 }
 
-std::string OperatorDivide::Print() const
+void OperatorDivide::PrintTo(std::string& out) const
 {
-    return BinaryOperator::PrintBinary("/", false, true);
+    BinaryOperator::PrintBinary(out, "/", false, true);
 }
 
-std::string OperatorMultiply::Print() const
+void OperatorMultiply::PrintTo(std::string& out) const
 {
     // If we are going to print x*31 instead print out 31x
-    if (dynamic_cast<Variable*>(left.get()) && dynamic_cast<Constant*>(right.get()))
-        return BinaryOperator::PrintBinary("", true, true);
-    else
-        return BinaryOperator::PrintBinary("", false, true);
+    if (left->Kind() == ExpressionKind::Variable && right->Kind() == ExpressionKind::Constant)
+        return BinaryOperator::PrintBinary(out, "", true, true);
+
+    // Juxtaposed numbers would run together, 3*2^x must not print as 32^x, and a juxtaposed
+    // sign would read as a subtraction, x*-y must not print as x-y
+    auto NeedsOperator = [](const ExpressionBase* expr)
+    {
+        if (auto lazy = ExpressionCast<LazyDerivative>(expr))
+            expr = &lazy->Expanded();
+
+        if (expr->Kind() == ExpressionKind::UnaryMinus)
+            return true;
+
+        if (auto exponent = ExpressionCast<OperatorExponent>(expr))
+            expr = &exponent->GetLeft();
+
+        return expr->Kind() == ExpressionKind::Constant;
+    };
+
+    BinaryOperator::PrintBinary(out, NeedsOperator(right.get()) ? "*" : "", false, true);
 }
 
-std::string OperatorExponent::Print() const
+void OperatorExponent::PrintTo(std::string& out) const
 {
-    return BinaryOperator::PrintBinary("^", false, false);
+    BinaryOperator::PrintBinary(out, "^", false, false);
 }
 
-std::string OperatorUnaryMinus::Print() const
+void OperatorUnaryMinus::PrintTo(std::string& out) const
 {
-    if (right->Priority() <= Priority())
-        return "-(" + right->Print() + ")";
-    else
-       return "-" + right->Print();
+    bool parenthesize = right->Priority() <= Priority();
+
+    out += parenthesize ? "-(" : "-";
+    right->PrintTo(out);
+    if (parenthesize) out += ')';
+}
+
+void LazyDerivative::PrintTo(std::string& out) const
+{
+    Expanded().PrintTo(out);
 }
 
 // DERIVATIVE FUNCTIONS
 //---------------------------------
 
-std::unique_ptr<ExpressionBase> Constant::Derivative(char wrt) const
+std::unique_ptr<ExpressionBase> Constant::DerivativeImpl(char wrt) const
 {
     return std::make_unique<Constant>(0);
 }
 
-std::unique_ptr<ExpressionBase> Variable::Derivative(char wrt) const
+std::unique_ptr<ExpressionBase> Variable::DerivativeImpl(char wrt) const
 {
     return std::make_unique<Constant>(wrt == pronumeral ? 1 : 0);
 }
 
-std::unique_ptr<ExpressionBase> OperatorPlus::Derivative(char wrt) const
+std::unique_ptr<ExpressionBase> OperatorPlus::DerivativeImpl(char wrt) const
 {
     return std::make_unique<OperatorPlus>(left->Derivative(wrt), right->Derivative(wrt));
 }
 
-std::unique_ptr<ExpressionBase> OperatorMinus::Derivative(char wrt) const
+std::unique_ptr<ExpressionBase> OperatorMinus::DerivativeImpl(char wrt) const
 {
     return std::make_unique<OperatorMinus>(left->Derivative(wrt), right->Derivative(wrt));
 }
 
-std::unique_ptr<ExpressionBase> OperatorMultiply::Derivative(char wrt) const
+std::unique_ptr<ExpressionBase> OperatorMultiply::DerivativeImpl(char wrt) const
 {
     return
         std::make_unique<OperatorPlus>(
             std::make_unique<OperatorMultiply>(
                 left->Clone(),
-                right->Derivative(wrt)),
+                LazyDerivative::Of(*right, wrt)),
             std::make_unique<OperatorMultiply>(
                 right->Clone(),
-                left->Derivative(wrt)));
+                LazyDerivative::Of(*left, wrt)));
 }
 
-std::unique_ptr<ExpressionBase> OperatorDivide::Derivative(char wrt) const
+std::unique_ptr<ExpressionBase> OperatorDivide::DerivativeImpl(char wrt) const
 {
     return 
         std::make_unique<OperatorDivide>(
             std::make_unique<OperatorMinus>(
                 std::make_unique<OperatorMultiply>(
                     right->Clone(),
-                    left->Derivative(wrt)),
+                    LazyDerivative::Of(*left, wrt)),
                 std::make_unique<OperatorMultiply>(
                     left->Clone(),
-                    right->Derivative(wrt))),
+                    LazyDerivative::Of(*right, wrt))),
             std::make_unique<OperatorExponent>(
                 right->Clone(),
                 std::make_unique<Constant>(2)));
 }
 
-std::unique_ptr<ExpressionBase> OperatorExponent::Derivative(char wrt) const
+std::unique_ptr<ExpressionBase> OperatorExponent::DerivativeImpl(char wrt) const
 {
     return 
         std::make_unique<OperatorMultiply>(
@@ -301,11 +635,17 @@ std::unique_ptr<ExpressionBase> OperatorExponent::Derivative(char wrt) const
                         std::make_unique<Constant>(1)))));
 }
 
-std::unique_ptr<ExpressionBase> OperatorUnaryMinus::Derivative(char wrt) const
+std::unique_ptr<ExpressionBase> OperatorUnaryMinus::DerivativeImpl(char wrt) const
 {
     return 
         std::make_unique<OperatorUnaryMinus>(
             right->Derivative(wrt));
 }
 
+std::unique_ptr<ExpressionBase> LazyDerivative::DerivativeImpl(char wrt) const
+{
+    // Stays lazy, the copy shares this node's operand
+    return std::make_unique<LazyDerivative>(Clone(), wrt);
+}
+
 //---------------------------------
\ No newline at end of file
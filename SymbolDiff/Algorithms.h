@@ -1,5 +1,70 @@
 #pragma once
 #include "Parser.h"
+#include "ExpressionArena.h"
 
-std::string Differentiate(const std::string& str, char wrt);
-bool ExpressionsNumericallyEqual(const ExpressionBase& lhs, const ExpressionBase& rhs);
\ No newline at end of file
+#ifdef SYMBOLDIFF_INSTRUMENTATION
+#include "Instrumentation.h"
+#endif
+
+enum class OutputFormat
+{
+	Expression,				// 2(x+1)/(x+1)^2
+	CommonSubexpressions,	// t1 = x+1; 2t1/t1^2, see PrintWithCommonSubexpressions
+};
+
+std::string Differentiate(const std::string& str, char wrt, OutputFormat format = OutputFormat::Expression);
+
+// Runs the whole pipeline with every node allocated from arena, which is reset first
+std::string Differentiate(const std::string& str, char wrt, ExpressionArena& arena, OutputFormat format = OutputFormat::Expression);
+
+struct DifferentiateResult
+{
+	std::string derivative;
+	std::string error;		// Empty on success
+#ifdef SYMBOLDIFF_INSTRUMENTATION
+	Instrumentation::Counters counters;		// The work of this input alone, see Instrumentation.h
+#endif
+};
+
+// f', f'', ... up to the order-th derivative, each simplified. Every order is differentiated from
+// the simplified one before it, within a single ExpressionDag, so a subexpression that recurs
+// across orders is only differentiated once.
+std::vector<std::unique_ptr<ExpressionBase>> Derivatives(const ExpressionBase& expr, char wrt, size_t order);
+std::vector<std::string> DifferentiateUpTo(const std::string& str, char wrt, size_t order);
+
+// Differentiates every input across the default thread pool. Results are in input order, and
+// an input that fails to parse gets its error message rather than throwing for the whole batch.
+// The work of every input is added to the caller's current Instrumentation, if any.
+std::vector<DifferentiateResult> DifferentiateBatch(const std::string* inputs, size_t count, char wrt, OutputFormat format = OutputFormat::Expression);
+std::vector<DifferentiateResult> DifferentiateBatch(const std::vector<std::string>& inputs, char wrt, OutputFormat format = OutputFormat::Expression);
+
+// Prints expr with every repeated subexpression bound once to a temporary ahead of it,
+// e.g. "t1 = x+1; t1^2+2t1". Without repeats this is the same as expr.Print().
+std::string PrintWithCommonSubexpressions(const ExpressionBase& expr);
+
+// The derivative of expr with the product and quotient rules leaving the derivatives of their
+// operands lazy, for callers that mostly evaluate it. Each of those is only built if printed,
+// simplified or differentiated again, and otherwise evaluated from its operand's dual numbers.
+std::unique_ptr<ExpressionBase> LazyDerivativeOf(const ExpressionBase& expr, char wrt);
+
+// The derivative of expr with respect to wrt at a point, via dual numbers rather than Derivative()
+std::optional<double> DerivativeAt(const ExpressionBase& expr, char wrt, const std::unordered_map<char, double>& values);
+
+// The Taylor coefficients f(a), f'(a), f''(a)/2!, ... up to order about the point values, via
+// Taylor mode propagation rather than symbolic derivatives. Returns nullopt if a variable has no value.
+std::optional<std::vector<double>> TaylorCoefficients(const ExpressionBase& expr, char wrt, const std::unordered_map<char, double>& values, size_t order);
+
+struct NumericEqualityOptions
+{
+	size_t samples = 1000;
+	double tolerance = 0.001;		// Relative
+	unsigned seed = 0;
+	// Differences this small always pass, for values that are 0 one way and rounding error another
+	double absoluteTolerance = 0;
+	// If false, a variable only one side has is sampled for both, so x-x equals 0
+	bool sameVariables = true;
+};
+
+// Compares both expressions at randomly sampled points, in parallel batches. Unless
+// options.sameVariables is false, expressions with different variables are never equal.
+bool ExpressionsNumericallyEqual(const ExpressionBase& lhs, const ExpressionBase& rhs, const NumericEqualityOptions& options = {});
\ No newline at end of file
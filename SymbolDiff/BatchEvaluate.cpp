@@ -0,0 +1,303 @@
+#include "BatchEvaluate.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define BATCH_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BATCH_SSE2
+#endif
+
+// MSVC lets us use AVX intrinsics in any function, GCC and Clang need them enabled per function
+#if defined(BATCH_X86) && (defined(__GNUC__) || defined(__clang__))
+#define BATCH_TARGET_AVX __attribute__((target("avx")))
+#else
+#define BATCH_TARGET_AVX
+#endif
+
+using OpCode = CompiledExpression::OpCode;
+
+namespace
+{
+    // Points are processed in chunks small enough for every register to stay in cache
+    constexpr size_t chunkSize = 256;
+
+    enum class InstructionSet
+    {
+        Scalar,
+        Sse2,
+        Avx,
+    };
+
+    InstructionSet DetectInstructionSet()
+    {
+#ifdef BATCH_X86
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+
+        // The OS must also save the upper halves of the ymm registers on a context switch
+        if (osxsave && avx && (_xgetbv(0) & 6) == 6)
+            return InstructionSet::Avx;
+#else
+        if (__builtin_cpu_supports("avx"))
+            return InstructionSet::Avx;
+#endif
+#endif
+
+#ifdef BATCH_SSE2
+        return InstructionSet::Sse2;
+#else
+        return InstructionSet::Scalar;
+#endif
+    }
+
+    InstructionSet ActiveInstructionSet()
+    {
+        static const InstructionSet active = DetectInstructionSet();
+        return active;
+    }
+
+    template <OpCode op>
+    double ApplyScalar(double l, double r)
+    {
+        if constexpr (op == OpCode::Plus) return l + r;
+        else if constexpr (op == OpCode::Minus) return l - r;
+        else if constexpr (op == OpCode::Multiply) return l * r;
+        else return l / r;
+    }
+
+    template <OpCode op>
+    void BinaryScalar(const double* l, const double* r, double* out, size_t begin, size_t count)
+    {
+        for (size_t i = begin; i < count; i++)
+            out[i] = ApplyScalar<op>(l[i], r[i]);
+    }
+
+    void NegateScalar(const double* r, double* out, size_t begin, size_t count)
+    {
+        for (size_t i = begin; i < count; i++)
+            out[i] = -r[i];
+    }
+
+#ifdef BATCH_SSE2
+    template <OpCode op>
+    void BinarySse2(const double* l, const double* r, double* out, size_t count)
+    {
+        size_t i = 0;
+
+        for (; i + 2 <= count; i += 2)
+        {
+            auto a = _mm_loadu_pd(l + i);
+            auto b = _mm_loadu_pd(r + i);
+
+            if constexpr (op == OpCode::Plus) _mm_storeu_pd(out + i, _mm_add_pd(a, b));
+            if constexpr (op == OpCode::Minus) _mm_storeu_pd(out + i, _mm_sub_pd(a, b));
+            if constexpr (op == OpCode::Multiply) _mm_storeu_pd(out + i, _mm_mul_pd(a, b));
+            if constexpr (op == OpCode::Divide) _mm_storeu_pd(out + i, _mm_div_pd(a, b));
+        }
+
+        BinaryScalar<op>(l, r, out, i, count);
+    }
+
+    void NegateSse2(const double* r, double* out, size_t count)
+    {
+        const auto sign = _mm_set1_pd(-0.0);
+        size_t i = 0;
+
+        for (; i + 2 <= count; i += 2)
+            _mm_storeu_pd(out + i, _mm_xor_pd(_mm_loadu_pd(r + i), sign));
+
+        NegateScalar(r, out, i, count);
+    }
+#endif
+
+#ifdef BATCH_X86
+    template <OpCode op>
+    BATCH_TARGET_AVX void BinaryAvx(const double* l, const double* r, double* out, size_t count)
+    {
+        size_t i = 0;
+
+        for (; i + 4 <= count; i += 4)
+        {
+            auto a = _mm256_loadu_pd(l + i);
+            auto b = _mm256_loadu_pd(r + i);
+
+            if constexpr (op == OpCode::Plus) _mm256_storeu_pd(out + i, _mm256_add_pd(a, b));
+            if constexpr (op == OpCode::Minus) _mm256_storeu_pd(out + i, _mm256_sub_pd(a, b));
+            if constexpr (op == OpCode::Multiply) _mm256_storeu_pd(out + i, _mm256_mul_pd(a, b));
+            if constexpr (op == OpCode::Divide) _mm256_storeu_pd(out + i, _mm256_div_pd(a, b));
+        }
+
+        BinaryScalar<op>(l, r, out, i, count);
+    }
+
+    BATCH_TARGET_AVX void NegateAvx(const double* r, double* out, size_t count)
+    {
+        const auto sign = _mm256_set1_pd(-0.0);
+        size_t i = 0;
+
+        for (; i + 4 <= count; i += 4)
+            _mm256_storeu_pd(out + i, _mm256_xor_pd(_mm256_loadu_pd(r + i), sign));
+
+        NegateScalar(r, out, i, count);
+    }
+#endif
+
+    template <OpCode op>
+    void Binary(InstructionSet set, const double* l, const double* r, double* out, size_t count)
+    {
+        switch (set)
+        {
+#ifdef BATCH_X86
+        case InstructionSet::Avx:
+            return BinaryAvx<op>(l, r, out, count);
+#endif
+#ifdef BATCH_SSE2
+        case InstructionSet::Sse2:
+            return BinarySse2<op>(l, r, out, count);
+#endif
+        default:
+            return BinaryScalar<op>(l, r, out, 0, count);
+        }
+    }
+
+    void Negate(InstructionSet set, const double* r, double* out, size_t count)
+    {
+        switch (set)
+        {
+#ifdef BATCH_X86
+        case InstructionSet::Avx:
+            return NegateAvx(r, out, count);
+#endif
+#ifdef BATCH_SSE2
+        case InstructionSet::Sse2:
+            return NegateSse2(r, out, count);
+#endif
+        default:
+            return NegateScalar(r, out, 0, count);
+        }
+    }
+}
+
+void EvaluateBatch(const CompiledExpression& compiled, const double* const* variables, double* results, size_t count)
+{
+    const auto set = ActiveInstructionSet();
+    const auto& instructions = compiled.Instructions();
+
+    // Every register owns a chunk of scratch space. A register may instead point straight
+    // into an input array (variables) or at a buffer filled once per call (constants).
+    std::vector<double> scratch(static_cast<size_t>(compiled.RegisterCount()) * chunkSize);
+    std::vector<std::vector<double>> constants;
+    std::vector<const double*> constantData(instructions.size(), nullptr);
+    std::vector<bool> constantSquare(instructions.size(), false);
+    std::vector<std::optional<double>> registerConstants(compiled.RegisterCount());
+
+    for (size_t i = 0; i < instructions.size(); i++)
+    {
+        const auto& instruction = instructions[i];
+
+        if (instruction.op == OpCode::Exponent)
+            constantSquare[i] = registerConstants[instruction.right] == 2.0;
+
+        if (instruction.op == OpCode::Constant)
+        {
+            constants.emplace_back(chunkSize, instruction.constant);
+            constantData[i] = constants.back().data();
+            registerConstants[instruction.destination] = instruction.constant;
+        }
+        else
+        {
+            registerConstants[instruction.destination] = std::nullopt;
+        }
+    }
+
+    std::vector<const double*> registers(compiled.RegisterCount());
+
+    for (size_t begin = 0; begin < count; begin += chunkSize)
+    {
+        auto n = std::min(chunkSize, count - begin);
+
+        for (size_t i = 0; i < instructions.size(); i++)
+        {
+            const auto& instruction = instructions[i];
+
+            if (instruction.op == OpCode::Constant)
+            {
+                registers[instruction.destination] = constantData[i];
+                continue;
+            }
+
+            if (instruction.op == OpCode::Variable)
+            {
+                registers[instruction.destination] = variables[instruction.left] + begin;
+                continue;
+            }
+
+            auto out = scratch.data() + static_cast<size_t>(instruction.destination) * chunkSize;
+            auto l = registers[instruction.left];
+            auto r = registers[instruction.right];
+
+            switch (instruction.op)
+            {
+            case OpCode::Plus:
+                Binary<OpCode::Plus>(set, l, r, out, n);
+                break;
+            case OpCode::Minus:
+                Binary<OpCode::Minus>(set, l, r, out, n);
+                break;
+            case OpCode::Multiply:
+                Binary<OpCode::Multiply>(set, l, r, out, n);
+                break;
+            case OpCode::Divide:
+                Binary<OpCode::Divide>(set, l, r, out, n);
+                break;
+            case OpCode::Exponent:
+                // There is no vector instruction for pow, but squaring is common enough
+                // (the quotient rule introduces one) to be worth a vectorized special case
+                if (constantSquare[i])
+                {
+                    Binary<OpCode::Multiply>(set, l, l, out, n);
+                }
+                else
+                {
+                    for (size_t j = 0; j < n; j++)
+                        out[j] = std::pow(l[j], r[j]);
+                }
+                break;
+            case OpCode::UnaryMinus:
+                Negate(set, r, out, n);
+                break;
+            default:
+                break;
+            }
+
+            registers[instruction.destination] = out;
+        }
+
+        std::copy(registers[compiled.ResultRegister()], registers[compiled.ResultRegister()] + n, results + begin);
+    }
+}
+
+std::string BatchInstructionSet()
+{
+    switch (ActiveInstructionSet())
+    {
+    case InstructionSet::Avx:
+        return "AVX";
+    case InstructionSet::Sse2:
+        return "SSE2";
+    default:
+        return "Scalar";
+    }
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include "CompiledExpression.h"
+
+#include <string>
+
+// Evaluates a compiled expression at 'count' points at once. The input is structure of arrays:
+// variables[slot] points to 'count' contiguous values for the variable in that slot of
+// compiled.Variables(). The arithmetic runs in AVX or SSE2 kernels where the CPU supports them.
+void EvaluateBatch(const CompiledExpression& compiled, const double* const* variables, double* results, size_t count);
+
+// The instruction set EvaluateBatch dispatches to on this machine: "AVX", "SSE2" or "Scalar"
+std::string BatchInstructionSet();
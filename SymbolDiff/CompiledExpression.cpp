@@ -0,0 +1,181 @@
+#include "CompiledExpression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+
+CompiledExpression CompiledExpression::Compile(const ExpressionBase& expr)
+{
+    auto set = expr.GetSetOfAllSubVariables();
+
+    std::vector<char> variables(set.begin(), set.end());
+    std::sort(variables.begin(), variables.end());
+
+    return Compile(expr, variables);
+}
+
+CompiledExpression CompiledExpression::Compile(const ExpressionBase& expr, const std::vector<char>& variables)
+{
+    ExpressionDag dag;
+    auto root = dag.Import(expr);
+
+    CompiledExpression compiled;
+    compiled.variables = variables;
+    compiled.Emit(dag, root);
+
+    return compiled;
+}
+
+uint32_t CompiledExpression::SlotOf(char variable) const
+{
+    auto pos = std::find(variables.begin(), variables.end(), variable);
+
+    if (pos == variables.end())
+        throw std::invalid_argument("Cannot compile expression: variable '" + std::string{ variable } + "' has no slot");
+
+    return static_cast<uint32_t>(std::distance(variables.begin(), pos));
+}
+
+void CompiledExpression::Emit(const ExpressionDag& dag, ExpressionDag::NodeId root)
+{
+    // Every node is computed once, in topological order, into a register that is released
+    // after the node's last use for a later node to reuse
+
+    auto order = dag.Reachable(root);
+
+    auto IsLeaf = [](const ExpressionDag::Node& node) { return node.op == OpCode::Constant || node.op == OpCode::Variable; };
+
+    std::vector<size_t> lastUse(root + 1, 0);
+    lastUse[root] = order.size();
+
+    for (size_t position = 0; position < order.size(); position++)
+    {
+        const auto& node = dag.GetNode(order[position]);
+
+        if (IsLeaf(node)) continue;
+        if (node.op != OpCode::UnaryMinus) lastUse[node.left] = position;
+        lastUse[node.right] = position;
+    }
+
+    std::vector<uint32_t> registerOf(root + 1, 0);
+    std::vector<uint32_t> released;
+
+    auto Release = [&](ExpressionDag::NodeId id, size_t position)
+    {
+        if (lastUse[id] == position)
+            released.push_back(registerOf[id]);
+    };
+
+    instructions.reserve(order.size());
+
+    for (size_t position = 0; position < order.size(); position++)
+    {
+        auto id = order[position];
+        const auto& node = dag.GetNode(id);
+
+        // Operands are read before the result is written, so the result may take their register
+        if (!IsLeaf(node))
+        {
+            if (node.op != OpCode::UnaryMinus) Release(node.left, position);
+            if (node.left != node.right || node.op == OpCode::UnaryMinus) Release(node.right, position);
+        }
+
+        uint32_t destination;
+
+        if (released.empty())
+        {
+            destination = registerCount++;
+        }
+        else
+        {
+            destination = released.back();
+            released.pop_back();
+        }
+
+        registerOf[id] = destination;
+
+        switch (node.op)
+        {
+        case OpCode::Constant:
+            instructions.push_back({ node.op, destination, 0, 0, node.value });
+            break;
+        case OpCode::Variable:
+            instructions.push_back({ node.op, destination, SlotOf(node.variable), 0, 0 });
+            break;
+        case OpCode::UnaryMinus:
+            instructions.push_back({ node.op, destination, 0, registerOf[node.right], 0 });
+            break;
+        default:
+            instructions.push_back({ node.op, destination, registerOf[node.left], registerOf[node.right], 0 });
+            break;
+        }
+    }
+
+    resultRegister = registerOf[root];
+}
+
+double CompiledExpression::Evaluate(const double* slots) const
+{
+    // Every register is written before it is read, but compilers cannot prove it for the result
+    double stackRegisters[32] = {};
+    std::unique_ptr<double[]> heapRegisters;
+    double* registers = stackRegisters;
+
+    if (registerCount > std::size(stackRegisters))
+    {
+        heapRegisters = std::make_unique<double[]>(registerCount);
+        registers = heapRegisters.get();
+    }
+
+    for (const auto& instruction : instructions)
+    {
+        auto& destination = registers[instruction.destination];
+
+        switch (instruction.op)
+        {
+        case OpCode::Constant:
+            destination = instruction.constant;
+            break;
+        case OpCode::Variable:
+            destination = slots[instruction.left];
+            break;
+        case OpCode::Plus:
+            destination = registers[instruction.left] + registers[instruction.right];
+            break;
+        case OpCode::Minus:
+            destination = registers[instruction.left] - registers[instruction.right];
+            break;
+        case OpCode::Multiply:
+            destination = registers[instruction.left] * registers[instruction.right];
+            break;
+        case OpCode::Divide:
+            destination = registers[instruction.left] / registers[instruction.right];
+            break;
+        case OpCode::Exponent:
+            destination = std::pow(registers[instruction.left], registers[instruction.right]);
+            break;
+        case OpCode::UnaryMinus:
+            destination = -registers[instruction.right];
+            break;
+        }
+    }
+
+    return registers[resultRegister];
+}
+
+std::optional<double> CompiledExpression::Evaluate(const std::unordered_map<char, double>& values) const
+{
+    std::vector<double> slots;
+    slots.reserve(variables.size());
+
+    for (auto variable : variables)
+    {
+        auto pos = values.find(variable);
+        if (pos == values.end()) return std::nullopt;
+        slots.push_back(pos->second);
+    }
+
+    return Evaluate(slots.data());
+}
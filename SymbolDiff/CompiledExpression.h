@@ -0,0 +1,50 @@
+#pragma once
+#include "ExpressionDag.h"
+
+#include <cstdint>
+#include <vector>
+
+// An expression lowered to a flat list of register instructions. Variables are read from a
+// dense array with one slot per entry of Variables(), so evaluating is a tight loop without
+// virtual calls, optionals or hash lookups. The expression goes through an ExpressionDag on
+// the way, so a repeated subexpression is only computed once.
+
+class CompiledExpression
+{
+public:
+	using OpCode = ExpressionDag::Op;
+
+	struct Instruction
+	{
+		OpCode op;
+		uint32_t destination;
+		uint32_t left;		// Variable: the slot to read
+		uint32_t right;		// UnaryMinus: the operand
+		double constant;
+	};
+
+	// Variables are given slots in ascending order
+	static CompiledExpression Compile(const ExpressionBase& expr);
+
+	// Uses the given slot order, so several expressions can share one slot array
+	static CompiledExpression Compile(const ExpressionBase& expr, const std::vector<char>& variables);
+
+	double Evaluate(const double* slots) const;
+	std::optional<double> Evaluate(const std::unordered_map<char, double>& values) const;
+
+	const std::vector<char>& Variables() const { return variables; }
+	const std::vector<Instruction>& Instructions() const { return instructions; }
+	uint32_t RegisterCount() const { return registerCount; }
+	uint32_t ResultRegister() const { return resultRegister; }
+
+private:
+	CompiledExpression() = default;
+
+	void Emit(const ExpressionDag& dag, ExpressionDag::NodeId root);
+	uint32_t SlotOf(char variable) const;
+
+	std::vector<char> variables;
+	std::vector<Instruction> instructions;
+	uint32_t registerCount = 0;
+	uint32_t resultRegister = 0;
+};
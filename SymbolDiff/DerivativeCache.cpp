@@ -0,0 +1,122 @@
+#include "DerivativeCache.h"
+#include "ExpressionArena.h"
+#include "Rewrite.h"
+
+namespace
+{
+    thread_local DerivativeCache* currentCache = nullptr;
+
+    size_t KeyOf(const ExpressionBase& expr, char wrt)
+    {
+        return expr.Hash() * 31 + static_cast<unsigned char>(wrt);
+    }
+
+    // Leaves are cheaper to recompute than to look up
+    bool Worth(const ExpressionBase& expr)
+    {
+        return expr.Kind() != ExpressionKind::Constant && expr.Kind() != ExpressionKind::Variable;
+    }
+}
+
+DerivativeCache::DerivativeCache() :
+    arena(ExpressionArena::Current())
+{
+}
+
+std::unique_ptr<ExpressionBase> DerivativeCache::Find(const ExpressionBase& expr, char wrt)
+{
+    auto range = entries.equal_range(KeyOf(expr, wrt));
+
+    // A matching hash only makes a hit likely, the expressions are compared to make sure
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        if (it->second.wrt == wrt && *it->second.expr == expr)
+        {
+            hits++;
+            return it->second.result->Clone();
+        }
+    }
+
+    misses++;
+    return nullptr;
+}
+
+void DerivativeCache::Store(const ExpressionBase& expr, char wrt, const ExpressionBase& result)
+{
+    ExpressionArena::Scope scope(arena);
+
+    // Copies, since the caller goes on to own (and possibly modify) result
+    entries.emplace(KeyOf(expr, wrt), Entry{ expr.Clone(), result.Clone(), wrt });
+}
+
+std::unique_ptr<ExpressionBase> DerivativeCache::FindDerivative(const ExpressionBase& expr, char wrt)
+{
+    return Find(expr, wrt);
+}
+
+std::unique_ptr<ExpressionBase> DerivativeCache::FindSimplified(const ExpressionBase& expr)
+{
+    return Find(expr, simplifiedKey);
+}
+
+void DerivativeCache::StoreDerivative(const ExpressionBase& expr, char wrt, const ExpressionBase& result)
+{
+    Store(expr, wrt, result);
+}
+
+void DerivativeCache::StoreSimplified(const ExpressionBase& expr, const ExpressionBase& result)
+{
+    Store(expr, simplifiedKey, result);
+}
+
+void DerivativeCache::Clear()
+{
+    entries.clear();
+    hits = 0;
+    misses = 0;
+}
+
+DerivativeCache* DerivativeCache::Current()
+{
+    return currentCache;
+}
+
+DerivativeCache::Scope::Scope(DerivativeCache& cache) :
+    previous(currentCache)
+{
+    currentCache = &cache;
+}
+
+DerivativeCache::Scope::~Scope()
+{
+    currentCache = previous;
+}
+
+//---------------------------------
+
+std::unique_ptr<ExpressionBase> ExpressionBase::Derivative(char wrt) const
+{
+    auto cache = currentCache;
+    // A derivative with lazy operands isn't what other callers expect back from the cache
+    if (!cache || !Worth(*this) || LazyDerivative::Enabled()) return DerivativeImpl(wrt);
+
+    if (auto cached = cache->FindDerivative(*this, wrt))
+        return cached;
+
+    auto result = DerivativeImpl(wrt);
+    cache->StoreDerivative(*this, wrt, *result);
+    return result;
+}
+
+std::unique_ptr<ExpressionBase> ExpressionBase::Simplified() const
+{
+    auto cache = currentCache;
+    if (!cache || !Worth(*this)) return RewriteEngine().Rewrite(Clone());
+
+    if (auto cached = cache->FindSimplified(*this))
+        return cached;
+
+    auto result = RewriteEngine().Rewrite(Clone());
+    cache->StoreSimplified(*this, *result);
+    return result;
+}
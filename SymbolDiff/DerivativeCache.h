@@ -0,0 +1,72 @@
+#pragma once
+#include "Expression.h"
+
+#include <unordered_map>
+
+class ExpressionArena;
+
+// Memo table for ExpressionBase::Derivative and Simplified, keyed by the structural hash of
+// the node plus the variable differentiated against. While a Scope is active on a thread,
+// both consult the cache before recursing and record what they compute, so a subexpression
+// that recurs (in the input, or in the copies the product and quotient rules make) is only
+// differentiated and simplified once. A cache may be kept across calls to share work between them.
+//
+// Entries are allocated from the ExpressionArena that was current when the cache was created,
+// so a cache made outside any arena can outlive the arenas of the calls using it.
+
+class DerivativeCache
+{
+public:
+	DerivativeCache();
+
+	DerivativeCache(const DerivativeCache&) = delete;
+	DerivativeCache& operator=(const DerivativeCache&) = delete;
+
+	// A copy of the cached result, or nullptr
+	std::unique_ptr<ExpressionBase> FindDerivative(const ExpressionBase& expr, char wrt);
+	std::unique_ptr<ExpressionBase> FindSimplified(const ExpressionBase& expr);
+
+	void StoreDerivative(const ExpressionBase& expr, char wrt, const ExpressionBase& result);
+	void StoreSimplified(const ExpressionBase& expr, const ExpressionBase& result);
+
+	void Clear();
+
+	size_t Hits() const { return hits; }
+	size_t Misses() const { return misses; }
+	size_t Size() const { return entries.size(); }
+
+	// The cache Derivative and Simplified use on this thread, or nullptr
+	static DerivativeCache* Current();
+
+	class Scope
+	{
+	public:
+		explicit Scope(DerivativeCache& cache);
+		~Scope();
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+	private:
+		DerivativeCache* previous;
+	};
+
+private:
+	// Simplified() results share the table, under a key no variable uses
+	static constexpr char simplifiedKey = '\0';
+
+	struct Entry
+	{
+		std::unique_ptr<ExpressionBase> expr;
+		std::unique_ptr<ExpressionBase> result;
+		char wrt;
+	};
+
+	std::unique_ptr<ExpressionBase> Find(const ExpressionBase& expr, char wrt);
+	void Store(const ExpressionBase& expr, char wrt, const ExpressionBase& result);
+
+	std::unordered_multimap<size_t, Entry> entries;
+	ExpressionArena* arena;
+	size_t hits = 0;
+	size_t misses = 0;
+};
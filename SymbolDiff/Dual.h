@@ -0,0 +1,51 @@
+#pragma once
+#include <cmath>
+
+// A value together with its derivative along some direction, for forward mode differentiation
+
+struct Dual
+{
+	double value;
+	double tangent;
+};
+
+inline Dual operator+(Dual l, Dual r)
+{
+	return { l.value + r.value, l.tangent + r.tangent };
+}
+
+inline Dual operator-(Dual l, Dual r)
+{
+	return { l.value - r.value, l.tangent - r.tangent };
+}
+
+inline Dual operator*(Dual l, Dual r)
+{
+	return { l.value * r.value, l.tangent * r.value + l.value * r.tangent };
+}
+
+inline Dual operator/(Dual l, Dual r)
+{
+	return { l.value / r.value, (l.tangent * r.value - l.value * r.tangent) / (r.value * r.value) };
+}
+
+inline Dual operator-(Dual r)
+{
+	return { -r.value, -r.tangent };
+}
+
+inline Dual Power(Dual l, Dual r)
+{
+	// d(a^b) = b a^(b-1) da + a^b ln(a) db. Terms with a zero tangent are skipped rather than
+	// multiplied out, so e.g. a constant exponent never evaluates ln of a negative base.
+	double value = std::pow(l.value, r.value);
+	double tangent = 0;
+
+	if (l.tangent != 0)
+		tangent += r.value * std::pow(l.value, r.value - 1) * l.tangent;
+
+	if (r.tangent != 0)
+		tangent += value * std::log(l.value) * r.tangent;
+
+	return { value, tangent };
+}
@@ -1,12 +1,14 @@
 #include "Expression.h"
+#include "ExpressionArena.h"
 
-#include <numeric>
+#include <algorithm>
+#include <mutex>
 #include <string>
 #include <assert.h>
 
 bool ExpressionBase::operator==(const ExpressionBase& other) const
 {
-    return typeid(*this) == typeid(other) && isEqual(other);
+    return kind == other.kind && isEqual(other);
 }
 
 bool Constant::isEqual(const ExpressionBase& other) const
@@ -28,6 +30,14 @@ bool BinaryOperator<Derived>::isEqual(const ExpressionBase& other) const
         (right && converted_other.right && *right == *converted_other.right);
 }
 
+bool LazyDerivative::isEqual(const ExpressionBase& other) const
+{
+    const auto& converted_other = static_cast<decltype(*this)>(other);
+
+    return state == converted_other.state ||
+        (GetVariable() == converted_other.GetVariable() && GetOperand() == converted_other.GetOperand());
+}
+
 template <typename Derived>
 bool UnaryOperator<Derived>::isEqual(const ExpressionBase& other) const
 {
@@ -36,6 +46,51 @@ bool UnaryOperator<Derived>::isEqual(const ExpressionBase& other) const
     return (right && converted_other.right && *right == *converted_other.right);
 }
 
+namespace
+{
+    size_t HashCombine(size_t seed, size_t value)
+    {
+        return seed ^ (value + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+    }
+}
+
+size_t ExpressionBase::Hash() const
+{
+    // 0 marks a hash that hasn't been computed yet
+    if (hash == 0)
+        hash = std::max<size_t>(ComputeHash(), 1);
+
+    return hash;
+}
+
+size_t Constant::ComputeHash() const
+{
+    // +0.0 so that 0 and -0, which compare equal, hash equal
+    return HashCombine(static_cast<size_t>(staticKind), std::hash<double>()(value + 0.0));
+}
+
+size_t Variable::ComputeHash() const
+{
+    return HashCombine(static_cast<size_t>(staticKind), std::hash<char>()(pronumeral));
+}
+
+template <typename Derived>
+size_t BinaryOperator<Derived>::ComputeHash() const
+{
+    return HashCombine(HashCombine(static_cast<size_t>(Derived::staticKind), left->Hash()), right->Hash());
+}
+
+template <typename Derived>
+size_t UnaryOperator<Derived>::ComputeHash() const
+{
+    return HashCombine(static_cast<size_t>(Derived::staticKind), right->Hash());
+}
+
+size_t LazyDerivative::ComputeHash() const
+{
+    return HashCombine(HashCombine(static_cast<size_t>(staticKind), GetOperand().Hash()), std::hash<char>()(GetVariable()));
+}
+
 std::unordered_set<char> ExpressionBase::GetSetOfAllSubVariables() const
 {
     std::unordered_set<char> variables;
@@ -45,7 +100,7 @@ std::unordered_set<char> ExpressionBase::GetSetOfAllSubVariables() const
 
 template <typename Derived>
 BinaryOperator<Derived>::BinaryOperator(std::unique_ptr<ExpressionBase>&& l, std::unique_ptr<ExpressionBase>&& r) :
-    left(std::move(l)), right(std::move(r)) 
+    ExpressionBase(Derived::staticKind), left(std::move(l)), right(std::move(r)) 
 {
     assert(left);
     assert(right);
@@ -53,7 +108,7 @@ BinaryOperator<Derived>::BinaryOperator(std::unique_ptr<ExpressionBase>&& l, std
 
 template <typename Derived>
 UnaryOperator<Derived>::UnaryOperator(std::unique_ptr<ExpressionBase>&& r) :
-    right(std::move(r)) 
+    ExpressionBase(Derived::staticKind), right(std::move(r)) 
 {
     assert(right);
 }
@@ -71,244 +126,132 @@ void BinaryOperator<Derived>::FillSetOfAllSubVariables(std::unordered_set<char>&
     right->FillSetOfAllSubVariables(variables);
 }
 
-void Variable::FillSetOfAllSubVariables(std::unordered_set<char>& variables) const
+namespace
 {
-    variables.insert(pronumeral);
-}
+    thread_local bool lazyOperands = false;
 
-void ExpressionBase::FillSetOfAllSubVariables(std::unordered_set<char>&) const
-{
-    // Do Nothing
-}
+    bool HasVaryingExponent(const ExpressionBase& expr, char wrt);
 
-//---------------------------------
+    template <typename T>
+    bool EitherHasVaryingExponent(const ExpressionBase& expr, char wrt)
+    {
+        const auto& op = static_cast<const T&>(expr);
+        return HasVaryingExponent(op.GetLeft(), wrt) || HasVaryingExponent(op.GetRight(), wrt);
+    }
 
-void ExpressionBase::GetConstantSubNodesFromPlus(std::vector<Constant*>& nodes)
-{
-    // Do Nothing
+    // Whether expr raises anything to a power that depends on wrt. The symbolic rules only apply
+    // the power rule, d(a^b) = b a^(b-1) da, where dual numbers also add a^b ln(a) db.
+    bool HasVaryingExponent(const ExpressionBase& expr, char wrt)
+    {
+        switch (expr.Kind())
+        {
+        case ExpressionKind::Plus: return EitherHasVaryingExponent<OperatorPlus>(expr, wrt);
+        case ExpressionKind::Minus: return EitherHasVaryingExponent<OperatorMinus>(expr, wrt);
+        case ExpressionKind::Multiply: return EitherHasVaryingExponent<OperatorMultiply>(expr, wrt);
+        case ExpressionKind::Divide: return EitherHasVaryingExponent<OperatorDivide>(expr, wrt);
+        case ExpressionKind::Exponent:
+            return static_cast<const OperatorExponent&>(expr).GetRight().GetSetOfAllSubVariables().count(wrt) ||
+                EitherHasVaryingExponent<OperatorExponent>(expr, wrt);
+        case ExpressionKind::UnaryMinus: return HasVaryingExponent(static_cast<const OperatorUnaryMinus&>(expr).GetRight(), wrt);
+        case ExpressionKind::LazyDerivative: return HasVaryingExponent(static_cast<const LazyDerivative&>(expr).GetOperand(), wrt);
+        default: return false;
+        }
+    }
 }
 
-void ExpressionBase::GetConstantSubNodesFromMultiply(std::vector<Constant*>& nodes)
+struct LazyDerivative::State
 {
-    // Do Nothing
-}
-
-void Constant::GetConstantSubNodesFromPlus(std::vector<Constant*>& nodes)
+    State(std::unique_ptr<ExpressionBase>&& operand, char wrt) :
+        operand(std::move(operand)), wrt(wrt), evaluatesByDuals(!HasVaryingExponent(*this->operand, wrt)) {}
+
+    std::unique_ptr<ExpressionBase> operand;
+    char wrt;
+    bool evaluatesByDuals;
+    std::once_flag expandOnce;
+    std::unique_ptr<ExpressionBase> expanded;
+};
+
+LazyDerivative::LazyDerivative(std::unique_ptr<ExpressionBase>&& operand, char wrt) :
+    state(std::make_shared<State>(std::move(operand), wrt))
 {
-    nodes.push_back(this);
+    assert(state->operand);
 }
 
-void Constant::GetConstantSubNodesFromMultiply(std::vector<Constant*>& nodes)
+bool LazyDerivative::Enabled()
 {
-    nodes.push_back(this);
+    return lazyOperands;
 }
 
-void OperatorPlus::GetConstantSubNodesFromPlus(std::vector<Constant*>& nodes)
+std::unique_ptr<ExpressionBase> LazyDerivative::Of(const ExpressionBase& operand, char wrt)
 {
-    left->GetConstantSubNodesFromPlus(nodes);
-    right->GetConstantSubNodesFromPlus(nodes);
-}
+    // The derivative of a leaf is already a single constant
+    if (!lazyOperands || operand.Kind() == ExpressionKind::Constant || operand.Kind() == ExpressionKind::Variable)
+        return operand.Derivative(wrt);
 
-void OperatorMultiply::GetConstantSubNodesFromMultiply(std::vector<Constant*>& nodes)
-{
-    left->GetConstantSubNodesFromMultiply(nodes);
-    right->GetConstantSubNodesFromMultiply(nodes);
+    return std::make_unique<LazyDerivative>(operand.Clone(), wrt);
 }
 
-//---------------------------------
-
-std::unique_ptr<ExpressionBase> ExpressionBase::Simplified() const
+LazyDerivative::Scope::Scope(bool enabled) :
+    previous(lazyOperands)
 {
-    // Do nothing
-    return Clone();
+    lazyOperands = enabled;
 }
 
-std::unique_ptr<ExpressionBase> OperatorPlus::Simplified() const
+LazyDerivative::Scope::~Scope()
 {
-    return Simplify(std::make_unique<OperatorPlus>(left->Simplified(), right->Simplified()));
+    lazyOperands = previous;
 }
 
-std::unique_ptr<ExpressionBase> OperatorPlus::Simplify(std::unique_ptr<OperatorPlus>&& expr)
+const ExpressionBase& LazyDerivative::GetOperand() const
 {
-    auto GetSum = [](std::vector<Constant*> vals)
-    {
-        return std::accumulate(vals.begin(), vals.end(), 0.0, [](double a, const Constant* b)
-            {
-                return a + b->GetConstant();
-            });
-    };
-
-    // Multiplication/addition can be done in any order e.g 3*(5*x) can be simplified
-    // This is complex, because we could have any number of multiplications
-    // or additions in order with constants or variables or whole expressions with brackets.
-    // The algorithm recursively finds all constant value leaf nodes from successive 
-    // multiplication or additions and then combines them into one constant, leaving the others 
-    // to be 1 for multiplication or 0 for addition. e.g: 3*x*4 -> 12*x*1 or 3+x+4 -> 7+x+0. 
-    // We do this simplification first because it could allow for further simplifications later
-
-    std::vector<Constant*> constantLeafs;
-    expr->GetConstantSubNodesFromPlus(constantLeafs);
-
-    double total = GetSum(constantLeafs);
-
-    for (size_t i = 0; i < constantLeafs.size(); i++)
-        constantLeafs[i]->SetConstant(i == 0 ? total : 0);
-
-    expr->left = expr->left->Simplified();
-    expr->right = expr->right->Simplified();
-
-    // x+0 -> x
-    if (dynamic_cast<Constant*>(expr->left.get()) && dynamic_cast<Constant*>(expr->left.get())->GetConstant() == 0)
-    {
-        return expr->right->Clone();
-    }
-
-    if (dynamic_cast<Constant*>(expr->right.get()) && dynamic_cast<Constant*>(expr->right.get())->GetConstant() == 0)
-    {
-        return expr->left->Clone();
-    }
-
-    auto evaluated = expr->EvaluateIfPossible();
-    if (evaluated) return evaluated;
-
-    return std::move(expr);
+    return *state->operand;
 }
 
-std::unique_ptr<ExpressionBase> OperatorMinus::Simplified() const
+char LazyDerivative::GetVariable() const
 {
-    auto copy = std::make_unique<OperatorMinus>(left->Simplified(), right->Simplified());
-
-    auto evaluated = copy->EvaluateIfPossible();
-    if (evaluated) return evaluated;
-
-    return copy;
-}
-
-std::unique_ptr<ExpressionBase> OperatorDivide::Simplified() const
-{
-    auto copy = std::make_unique<OperatorDivide>(left->Simplified(), right->Simplified());
-
-    auto evaluated = copy->EvaluateIfPossible();
-    if (evaluated) return evaluated;
-
-    return copy;
+    return state->wrt;
 }
 
-std::unique_ptr<ExpressionBase> OperatorMultiply::Simplified() const
+bool LazyDerivative::EvaluatesByDuals() const
 {
-    return Simplify(std::make_unique<OperatorMultiply>(left->Simplified(), right->Simplified()));
+    return state->evaluatesByDuals;
 }
 
-std::unique_ptr<ExpressionBase> OperatorMultiply::Simplify(std::unique_ptr<OperatorMultiply>&& expr)
+const ExpressionBase& LazyDerivative::Expanded() const
 {
-    auto GetProduct = [](std::vector<Constant*> vals)
-    {
-        return std::accumulate(vals.begin(), vals.end(), 1.0, [](double a, const Constant* b)
-            {
-                return a * b->GetConstant();
-            });
-    };
-
-    // Multiplication/addition can be done in any order e.g 3*(5*x) can be simplified
-    // This is complex, because we could have any number of multiplications
-    // or additions in order with constants or variables or whole expressions with brackets.
-    // The algorithm recursively finds all constant value leaf nodes from successive 
-    // multiplication or additions and then combines them into one constant, leaving the others 
-    // to be 1 for multiplication or 0 for addition. e.g: 3*x*4 -> 12*x*1 or 3+x+4 -> 7+x+0. 
-    // We do this simplification first because it could allow for further simplifications later
-
-    std::vector<Constant*> constantLeafs;
-    expr->GetConstantSubNodesFromMultiply(constantLeafs);
-
-    double total = GetProduct(constantLeafs);
-
-    for (size_t i = 0; i < constantLeafs.size(); i++)
-        constantLeafs[i]->SetConstant(i == 0 ? total : 1);
-
-    expr->left = expr->left->Simplified();
-    expr->right = expr->right->Simplified();
-
-    // x*0 -> 0
-    if ((dynamic_cast<Constant*>(expr->left.get()) && dynamic_cast<Constant*>(expr->left.get())->GetConstant() == 0) ||
-        (dynamic_cast<Constant*>(expr->right.get()) && dynamic_cast<Constant*>(expr->right.get())->GetConstant() == 0))
-    {
-        return std::make_unique<Constant>(0);
-    }
-
-    // x*1 -> x
-    if (dynamic_cast<Constant*>(expr->left.get()) && dynamic_cast<Constant*>(expr->left.get())->GetConstant() == 1)
-    {
-        return expr->right->Clone();
-    }
-
-    if (dynamic_cast<Constant*>(expr->right.get()) && dynamic_cast<Constant*>(expr->right.get())->GetConstant() == 1)
+    std::call_once(state->expandOnce, [this]
     {
-        return expr->left->Clone();
-    }
+        // The expansion is shared, so it's the full derivative whatever the thread expanding it does
+        ExpressionArena::Scope heap(nullptr);
+        Scope eager(false);
+        state->expanded = state->operand->Derivative(state->wrt);
+    });
 
-    auto evaluated = expr->EvaluateIfPossible();
-    if (evaluated) return evaluated;
-
-    return std::move(expr);
+    return *state->expanded;
 }
 
-std::unique_ptr<ExpressionBase> OperatorExponent::Simplify(std::unique_ptr<OperatorExponent>&& expr)
+void LazyDerivative::FillSetOfAllSubVariables(std::unordered_set<char>& variables) const
 {
-    // x^1 -> x, 1^x -> 1
-    if (dynamic_cast<Constant*>(expr->left.get()) && dynamic_cast<Constant*>(expr->left.get())->GetConstant() == 1)
-    {
-        return std::make_unique<Constant>(1);
-    }
-
-    if (dynamic_cast<Constant*>(expr->right.get()) && dynamic_cast<Constant*>(expr->right.get())->GetConstant() == 1)
-    {
-        return expr->left->Clone();
-    }
-
-    auto evaluated = expr->EvaluateIfPossible();
-    if (evaluated) return evaluated;
-
-    return std::move(expr);
+    state->operand->FillSetOfAllSubVariables(variables);
 }
 
-std::unique_ptr<ExpressionBase> OperatorExponent::Simplified() const
+void Variable::FillSetOfAllSubVariables(std::unordered_set<char>& variables) const
 {
-    return Simplify(std::make_unique<OperatorExponent>(left->Simplified(), right->Simplified()));
+    variables.insert(pronumeral);
 }
 
-std::unique_ptr<ExpressionBase> OperatorUnaryMinus::Simplified() const
+void ExpressionBase::FillSetOfAllSubVariables(std::unordered_set<char>&) const
 {
-    auto copy = std::make_unique<OperatorUnaryMinus>(right->Simplified());
-
-    auto evaluated = copy->EvaluateIfPossible();
-    if (evaluated) return evaluated;
-
-    return copy;
+    // Do Nothing
 }
 
 //---------------------------------
 
-template <typename Derived>
-std::unique_ptr<ExpressionBase> BinaryOperator<Derived>::EvaluateIfPossible() const
-{
-    // Evaluate to a constant if possible
-
-    auto eval = this->Evaluate();
-    if (eval)
-        return std::make_unique<Constant>(*eval);
-    else
-        return { nullptr };
-}
-
-template <typename Derived>
-std::unique_ptr<ExpressionBase> UnaryOperator<Derived>::EvaluateIfPossible() const
-{
-    // Evaluate to a constant if possible
-
-    auto eval = this->Evaluate();
-    if (eval)
-        return std::make_unique<Constant>(*eval);
-    else
-        return { nullptr };
-}
-
+// The template members above are defined here rather than in the header, so every
+// instantiation the other translation units use has to be made explicitly
+template class BinaryOperator<OperatorPlus>;
+template class BinaryOperator<OperatorMinus>;
+template class BinaryOperator<OperatorMultiply>;
+template class BinaryOperator<OperatorDivide>;
+template class BinaryOperator<OperatorExponent>;
+template class UnaryOperator<OperatorUnaryMinus>;
@@ -1,60 +1,110 @@
 #pragma once
+#include <cstdint>
 #include <memory>
 #include <unordered_map>
 #include <unordered_set>
 #include <optional>
 
-class Constant;
+#include "Dual.h"
+
+#ifdef SYMBOLDIFF_INSTRUMENTATION
+#include "Instrumentation.h"
+#else
+#define SYMBOLDIFF_COUNT(counter) ((void)0)
+#endif
+
+// The concrete type of a node, so type tests are a single compare rather than RTTI
+enum class ExpressionKind : uint8_t
+{
+	Constant,
+	Variable,
+	Plus,
+	Minus,
+	Multiply,
+	Divide,
+	Exponent,
+	UnaryMinus,
+	LazyDerivative,
+};
 
 class ExpressionBase
 {
 public:
+	explicit ExpressionBase(ExpressionKind kind) : kind(kind) {}
 	virtual ~ExpressionBase() = default;
 
+	ExpressionKind Kind() const { return kind; }
+
+	// Nodes are allocated from the current ExpressionArena if there is one (see ExpressionArena.h)
+	static void* operator new(size_t size);
+	static void operator delete(void* ptr);
+
 	virtual std::optional<double> Evaluate(const std::unordered_map<char, double>& values = {}) const = 0;
-	virtual std::string Print() const = 0;
+	// Evaluates along with the directional derivative, where direction gives each variable's tangent (0 if absent)
+	virtual std::optional<Dual> EvaluateDual(const std::unordered_map<char, double>& values, const std::unordered_map<char, double>& direction) const = 0;
+	std::string Print() const;
+	// Appends to out rather than returning a string, so a whole tree prints into one buffer
+	virtual void PrintTo(std::string& out) const = 0;
 	virtual std::unique_ptr<ExpressionBase> Clone() const = 0;
 
-	virtual std::unique_ptr<ExpressionBase> Derivative(char wrt) const = 0;
-	virtual std::unique_ptr<ExpressionBase> Simplified() const;
+	// Both are memoized while a DerivativeCache is active (see DerivativeCache.h).
+	// Simplified rewrites a copy with the rules of RewriteEngine (see Rewrite.h).
+	std::unique_ptr<ExpressionBase> Derivative(char wrt) const;
+	std::unique_ptr<ExpressionBase> Simplified() const;
 
-	bool operator==(const ExpressionBase& other) const;
+	// Structural hash, equal expressions have equal hashes. Cached in the node once computed.
+	size_t Hash() const;
 
-	virtual void GetConstantSubNodesFromPlus(std::vector<Constant*>& nodes);
-	virtual void GetConstantSubNodesFromMultiply(std::vector<Constant*>& nodes);
+	bool operator==(const ExpressionBase& other) const;
 
 	virtual std::unordered_set<char> GetSetOfAllSubVariables() const;
 	virtual void FillSetOfAllSubVariables(std::unordered_set<char>& variables) const;
 
+	// How tightly the operator binds when printed, operands that bind looser are parenthesized
 	int Priority() const;
 
+protected:
+	void InvalidateHash() { hash = 0; }
+
 private:
 	virtual bool isEqual(const ExpressionBase& other) const = 0;
+	virtual size_t ComputeHash() const = 0;
+
+	virtual std::unique_ptr<ExpressionBase> DerivativeImpl(char wrt) const = 0;
+
+	mutable size_t hash = 0;
+	ExpressionKind kind;
 };
 
 template <typename Derived>
 class Expression : public ExpressionBase
 {
 public:
-	std::unique_ptr<ExpressionBase> Clone() const override { return std::make_unique<Derived>(static_cast<Derived const&>(*this)); }
+	Expression() : ExpressionBase(Derived::staticKind) {}
+
+	std::unique_ptr<ExpressionBase> Clone() const override { SYMBOLDIFF_COUNT(nodesCloned); return std::make_unique<Derived>(static_cast<Derived const&>(*this)); }
 };
 
 class Constant : public Expression<Constant>
 {
 public:
+	static constexpr auto staticKind = ExpressionKind::Constant;
+
 	explicit Constant(double val) : value(val) {}
 
 	auto GetConstant() const { return value; };
-	void SetConstant(double val) { value = val; }
+	void SetConstant(double val) { value = val; InvalidateHash(); }
 
-	std::string Print() const override;
+	void PrintTo(std::string& out) const override;
 	std::optional<double> Evaluate(const std::unordered_map<char, double>& values = {}) const override;
-	std::unique_ptr<ExpressionBase> Derivative(char wrt) const override;
+	std::optional<Dual> EvaluateDual(const std::unordered_map<char, double>& values, const std::unordered_map<char, double>& direction) const override;
 
-	void GetConstantSubNodesFromPlus(std::vector<Constant*>& nodes) override;
-	void GetConstantSubNodesFromMultiply(std::vector<Constant*>& nodes) override;
+	// Appends value in the shortest form that reads back exactly, in fixed notation so the lexer can read it
+	static void Format(double value, std::string& out);
 
 private:
+	std::unique_ptr<ExpressionBase> DerivativeImpl(char wrt) const override;
+	size_t ComputeHash() const override;
 	bool isEqual(const ExpressionBase& other) const override;
 
 	double value;
@@ -63,17 +113,21 @@ private:
 class Variable : public Expression<Variable>
 {
 public:
+	static constexpr auto staticKind = ExpressionKind::Variable;
+
 	explicit Variable(char val) : pronumeral(val) {}
 
 	auto GetVariable() const { return pronumeral; };
 
-	std::string Print() const override;
+	void PrintTo(std::string& out) const override;
 	std::optional<double> Evaluate(const std::unordered_map<char, double>& values = {}) const override;
-	std::unique_ptr<ExpressionBase> Derivative(char wrt) const override;
+	std::optional<Dual> EvaluateDual(const std::unordered_map<char, double>& values, const std::unordered_map<char, double>& direction) const override;
 
 	void FillSetOfAllSubVariables(std::unordered_set<char>& variables) const override;
 
 private:
+	std::unique_ptr<ExpressionBase> DerivativeImpl(char wrt) const override;
+	size_t ComputeHash() const override;
 	bool isEqual(const ExpressionBase& other) const override;
 
 	char pronumeral;
@@ -83,17 +137,22 @@ template <typename Derived>
 class BinaryOperator : public ExpressionBase
 {
 public:
-	std::unique_ptr<ExpressionBase> Clone() const override { return std::make_unique<Derived>(left->Clone(), right->Clone()); }
+	std::unique_ptr<ExpressionBase> Clone() const override { SYMBOLDIFF_COUNT(nodesCloned); return std::make_unique<Derived>(left->Clone(), right->Clone()); }
 
 	BinaryOperator(std::unique_ptr<ExpressionBase>&& l, std::unique_ptr<ExpressionBase>&& r);
 
+	const ExpressionBase& GetLeft() const { return *left; }
+	const ExpressionBase& GetRight() const { return *right; }
+
 	void FillSetOfAllSubVariables(std::unordered_set<char>& variables) const override;
 
 protected:
+	friend class RewriteEngine;
+
+	size_t ComputeHash() const override;
 	bool isEqual(const ExpressionBase& other) const override;
-	std::unique_ptr<ExpressionBase> EvaluateIfPossible() const;
 
-	std::string PrintBinary(const std::string& op, bool swap, bool leftAssosiative) const;
+	void PrintBinary(std::string& out, const char* op, bool swap, bool leftAssosiative) const;
 
 	std::unique_ptr<ExpressionBase> left;
 	std::unique_ptr<ExpressionBase> right;
@@ -102,84 +161,95 @@ protected:
 class OperatorPlus : public BinaryOperator<OperatorPlus>
 {
 public:
+	static constexpr auto staticKind = ExpressionKind::Plus;
+
 	using BinaryOperator::BinaryOperator;
 
 	std::optional<double> Evaluate(const std::unordered_map<char, double>& values = {}) const override;
-	std::unique_ptr<ExpressionBase> Derivative(char wrt) const override;
-	std::unique_ptr<ExpressionBase> Simplified() const override;
-	std::string Print() const override;
-
-	void GetConstantSubNodesFromPlus(std::vector<Constant*>& nodes) override;
+	std::optional<Dual> EvaluateDual(const std::unordered_map<char, double>& values, const std::unordered_map<char, double>& direction) const override;
+	void PrintTo(std::string& out) const override;
 
 private:
-	static std::unique_ptr<ExpressionBase> Simplify(std::unique_ptr<OperatorPlus>&& expr);
+	std::unique_ptr<ExpressionBase> DerivativeImpl(char wrt) const override;
 };
 
 class OperatorMinus : public BinaryOperator<OperatorMinus>
 {
 public:
+	static constexpr auto staticKind = ExpressionKind::Minus;
+
 	using BinaryOperator::BinaryOperator;
 
 	std::optional<double> Evaluate(const std::unordered_map<char, double>& values = {}) const override;
-	std::unique_ptr<ExpressionBase> Derivative(char wrt) const override;
-	std::unique_ptr<ExpressionBase> Simplified() const override;
-	std::string Print() const override;
+	std::optional<Dual> EvaluateDual(const std::unordered_map<char, double>& values, const std::unordered_map<char, double>& direction) const override;
+	void PrintTo(std::string& out) const override;
+
+private:
+	std::unique_ptr<ExpressionBase> DerivativeImpl(char wrt) const override;
 };
 
 class OperatorMultiply : public BinaryOperator<OperatorMultiply>
 {
 public:
+	static constexpr auto staticKind = ExpressionKind::Multiply;
+
 	using BinaryOperator::BinaryOperator;
 
 	std::optional<double> Evaluate(const std::unordered_map<char, double>& values = {}) const override;
-	std::unique_ptr<ExpressionBase> Derivative(char wrt) const override;
-	std::unique_ptr<ExpressionBase> Simplified() const override;
-	std::string Print() const override;
-
-	void GetConstantSubNodesFromMultiply(std::vector<Constant*>& nodes) override;
+	std::optional<Dual> EvaluateDual(const std::unordered_map<char, double>& values, const std::unordered_map<char, double>& direction) const override;
+	void PrintTo(std::string& out) const override;
 
 private:
-	static std::unique_ptr<ExpressionBase> Simplify(std::unique_ptr<OperatorMultiply>&& expr);
+	std::unique_ptr<ExpressionBase> DerivativeImpl(char wrt) const override;
 };
 
 class OperatorDivide : public BinaryOperator<OperatorDivide>
 {
 public:
+	static constexpr auto staticKind = ExpressionKind::Divide;
+
 	using BinaryOperator::BinaryOperator;
 
 	std::optional<double> Evaluate(const std::unordered_map<char, double>& values = {}) const override;
-	std::unique_ptr<ExpressionBase> Derivative(char wrt) const override;
-	std::unique_ptr<ExpressionBase> Simplified() const override;
-	std::string Print() const override;
+	std::optional<Dual> EvaluateDual(const std::unordered_map<char, double>& values, const std::unordered_map<char, double>& direction) const override;
+	void PrintTo(std::string& out) const override;
+
+private:
+	std::unique_ptr<ExpressionBase> DerivativeImpl(char wrt) const override;
 };
 
 class OperatorExponent : public BinaryOperator<OperatorExponent>
 {
 public:
+	static constexpr auto staticKind = ExpressionKind::Exponent;
+
 	using BinaryOperator::BinaryOperator;
 
 	std::optional<double> Evaluate(const std::unordered_map<char, double>& values = {}) const override;
-	std::unique_ptr<ExpressionBase> Derivative(char wrt) const override;
-	std::unique_ptr<ExpressionBase> Simplified() const override;
-	std::string Print() const override;
+	std::optional<Dual> EvaluateDual(const std::unordered_map<char, double>& values, const std::unordered_map<char, double>& direction) const override;
+	void PrintTo(std::string& out) const override;
 
 private:
-	static std::unique_ptr<ExpressionBase> Simplify(std::unique_ptr<OperatorExponent>&& expr);
+	std::unique_ptr<ExpressionBase> DerivativeImpl(char wrt) const override;
 };
 
 template <typename Derived>
 class UnaryOperator : public ExpressionBase
 {
 public:
-	std::unique_ptr<ExpressionBase> Clone() const override { return std::make_unique<Derived>(right->Clone()); }
+	std::unique_ptr<ExpressionBase> Clone() const override { SYMBOLDIFF_COUNT(nodesCloned); return std::make_unique<Derived>(right->Clone()); }
 
 	explicit UnaryOperator(std::unique_ptr<ExpressionBase>&& r);
 
+	const ExpressionBase& GetRight() const { return *right; }
+
 	void FillSetOfAllSubVariables(std::unordered_set<char>& variables) const override;
 
 protected:
+	friend class RewriteEngine;
+
+	size_t ComputeHash() const override;
 	bool isEqual(const ExpressionBase& other) const override;
-	std::unique_ptr<ExpressionBase> EvaluateIfPossible() const;
 
 	std::unique_ptr<ExpressionBase> right;
 };
@@ -187,11 +257,89 @@ protected:
 class OperatorUnaryMinus : public UnaryOperator<OperatorUnaryMinus>
 {
 public:
+	static constexpr auto staticKind = ExpressionKind::UnaryMinus;
+
 	using UnaryOperator::UnaryOperator;
 
 	std::optional<double> Evaluate(const std::unordered_map<char, double>& values = {}) const override;
-	std::unique_ptr<ExpressionBase> Derivative(char wrt) const override;
-	std::unique_ptr<ExpressionBase> Simplified() const override;
-	std::string Print() const override;
+	std::optional<Dual> EvaluateDual(const std::unordered_map<char, double>& values, const std::unordered_map<char, double>& direction) const override;
+	void PrintTo(std::string& out) const override;
+
+private:
+	std::unique_ptr<ExpressionBase> DerivativeImpl(char wrt) const override;
 };
 
+// The derivative of operand by wrt, expanded into an actual derivative tree only once something
+// needs its structure: printing it, differentiating it again or simplifying it. Evaluate goes
+// through the operand's dual numbers instead, as DerivativeAt does, so evaluating the derivative
+// costs no more than evaluating the operand. That is unless an exponent of the operand depends
+// on wrt: the expansion only applies the power rule there, and the node must evaluate to what it
+// expands to, so it evaluates the expansion. Copies share the operand and the expansion.
+// While a Scope is active on a thread, the product and quotient rules leave the derivatives of
+// their operands as lazy nodes, see LazyDerivativeOf.
+class LazyDerivative : public Expression<LazyDerivative>
+{
+public:
+	static constexpr auto staticKind = ExpressionKind::LazyDerivative;
+
+	LazyDerivative(std::unique_ptr<ExpressionBase>&& operand, char wrt);
+
+	// Whether the rules on this thread defer the derivatives of their operands
+	static bool Enabled();
+
+	// The derivative of operand, deferred if Enabled() and it's more than a leaf
+	static std::unique_ptr<ExpressionBase> Of(const ExpressionBase& operand, char wrt);
+
+	class Scope
+	{
+	public:
+		// false makes the rules eager again while the scope is active
+		explicit Scope(bool enabled = true);
+		~Scope();
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+	private:
+		bool previous;
+	};
+
+	const ExpressionBase& GetOperand() const;
+	char GetVariable() const;
+
+	// Built on first use, on the heap since copies may outlive the arena this one is in, and
+	// only once however many threads ask at the same time
+	const ExpressionBase& Expanded() const;
+
+	void PrintTo(std::string& out) const override;
+	std::optional<double> Evaluate(const std::unordered_map<char, double>& values = {}) const override;
+	std::optional<Dual> EvaluateDual(const std::unordered_map<char, double>& values, const std::unordered_map<char, double>& direction) const override;
+
+	// Those of the operand, as expanding may only cancel some out
+	void FillSetOfAllSubVariables(std::unordered_set<char>& variables) const override;
+
+private:
+	std::unique_ptr<ExpressionBase> DerivativeImpl(char wrt) const override;
+	size_t ComputeHash() const override;
+	bool isEqual(const ExpressionBase& other) const override;
+
+	// False where the dual numbers would disagree with the expansion, decided once on construction
+	bool EvaluatesByDuals() const;
+
+	struct State;
+
+	std::shared_ptr<State> state;
+};
+
+// A dynamic_cast by kind tag, nullptr if expr isn't a T
+template <typename T>
+const T* ExpressionCast(const ExpressionBase* expr)
+{
+	return expr && expr->Kind() == T::staticKind ? static_cast<const T*>(expr) : nullptr;
+}
+
+template <typename T>
+T* ExpressionCast(ExpressionBase* expr)
+{
+	return expr && expr->Kind() == T::staticKind ? static_cast<T*>(expr) : nullptr;
+}
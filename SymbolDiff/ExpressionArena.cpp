@@ -0,0 +1,130 @@
+#include "ExpressionArena.h"
+#include "Expression.h"
+#include "Instrumentation.h"
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+
+namespace
+{
+    thread_local ExpressionArena* currentArena = nullptr;
+    std::atomic<size_t> heapAllocations{ 0 };
+
+    // Every node is prefixed with a header recording the arena it came from (nullptr for the heap).
+    // The header is padded so the node itself stays suitably aligned.
+    constexpr size_t headerSize = alignof(std::max_align_t);
+
+    constexpr size_t AlignUp(size_t size)
+    {
+        return (size + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+    }
+}
+
+ExpressionArena::ExpressionArena(size_t blockSize) :
+    blockSize(AlignUp(blockSize))
+{
+}
+
+void* ExpressionArena::Allocate(size_t size)
+{
+    size = AlignUp(size);
+
+    while (currentBlock < blocks.size() && offset + size > blocks[currentBlock].size)
+    {
+        currentBlock++;
+        offset = 0;
+    }
+
+    if (currentBlock == blocks.size())
+    {
+        auto newSize = std::max(blockSize, size);
+        blocks.push_back({ std::make_unique<char[]>(newSize), newSize });
+        offset = 0;
+    }
+
+    void* memory = blocks[currentBlock].memory.get() + offset;
+    offset += size;
+    allocations++;
+
+    return memory;
+}
+
+void ExpressionArena::Reset()
+{
+    // Blocks are kept so the next pipeline run doesn't have to allocate them again
+    currentBlock = 0;
+    offset = 0;
+    allocations = 0;
+}
+
+size_t ExpressionArena::BytesUsed() const
+{
+    size_t total = offset;
+
+    for (size_t i = 0; i < currentBlock && i < blocks.size(); i++)
+        total += blocks[i].size;
+
+    return total;
+}
+
+ExpressionArena* ExpressionArena::Current()
+{
+    return currentArena;
+}
+
+size_t ExpressionArena::HeapAllocations()
+{
+    return heapAllocations.load(std::memory_order_relaxed);
+}
+
+ExpressionArena::Scope::Scope(ExpressionArena& arena) :
+    previous(currentArena)
+{
+    currentArena = &arena;
+}
+
+ExpressionArena::Scope::Scope(ExpressionArena* arena) :
+    previous(currentArena)
+{
+    currentArena = arena;
+}
+
+ExpressionArena::Scope::~Scope()
+{
+    currentArena = previous;
+}
+
+//---------------------------------
+
+void* ExpressionBase::operator new(size_t size)
+{
+    auto arena = currentArena;
+    void* memory;
+
+    SYMBOLDIFF_COUNT(nodesAllocated);
+
+    if (arena)
+    {
+        memory = arena->Allocate(size + headerSize);
+    }
+    else
+    {
+        memory = ::operator new(size + headerSize);
+        heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    *static_cast<ExpressionArena**>(memory) = arena;
+    return static_cast<char*>(memory) + headerSize;
+}
+
+void ExpressionBase::operator delete(void* ptr)
+{
+    if (!ptr) return;
+
+    auto memory = static_cast<char*>(ptr) - headerSize;
+
+    // Arena nodes are released all at once by the arena
+    if (*reinterpret_cast<ExpressionArena**>(memory) == nullptr)
+        ::operator delete(memory);
+}
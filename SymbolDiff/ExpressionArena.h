@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// A bump allocator for expression nodes. While a Scope is active on a thread, every node
+// created on that thread is carved out of the arena instead of the global heap, and deleting
+// such a node only runs its destructor. The memory is released in one shot by Reset() or
+// when the arena is destroyed, so nodes allocated in an arena must not outlive either.
+
+class ExpressionArena
+{
+public:
+	explicit ExpressionArena(size_t blockSize = 64 * 1024);
+
+	ExpressionArena(const ExpressionArena&) = delete;
+	ExpressionArena& operator=(const ExpressionArena&) = delete;
+
+	void* Allocate(size_t size);
+	void Reset();
+
+	// Allocations made since the last Reset()
+	size_t Allocations() const { return allocations; }
+	size_t BytesUsed() const;
+
+	// The arena new nodes on this thread are allocated from, or nullptr for the global heap
+	static ExpressionArena* Current();
+
+	// Total number of nodes allocated from the global heap, across all threads
+	static size_t HeapAllocations();
+
+	class Scope
+	{
+	public:
+		explicit Scope(ExpressionArena& arena);
+		// nullptr allocates from the global heap while the scope is active
+		explicit Scope(ExpressionArena* arena);
+		~Scope();
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+	private:
+		ExpressionArena* previous;
+	};
+
+private:
+	struct Block
+	{
+		std::unique_ptr<char[]> memory;
+		size_t size;
+	};
+
+	std::vector<Block> blocks;
+	size_t blockSize;
+	size_t currentBlock = 0;
+	size_t offset = 0;
+	size_t allocations = 0;
+};
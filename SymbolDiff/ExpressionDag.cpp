@@ -0,0 +1,535 @@
+#include "ExpressionDag.h"
+#include "Taylor.h"
+
+#include <cmath>
+#include <functional>
+#include <stdexcept>
+#include <unordered_set>
+
+bool ExpressionDag::Node::operator==(const Node& other) const
+{
+    return op == other.op && variable == other.variable && left == other.left && right == other.right && value == other.value;
+}
+
+size_t ExpressionDag::NodeHash::operator()(const Node& node) const
+{
+    size_t hash = std::hash<double>()(node.value);
+
+    auto combine = [&hash](size_t value)
+    {
+        hash ^= value + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+    };
+
+    combine(static_cast<size_t>(node.op));
+    combine(static_cast<size_t>(node.variable));
+    combine(node.left);
+    combine(node.right);
+
+    return hash;
+}
+
+ExpressionDag::NodeId ExpressionDag::Intern(const Node& node)
+{
+    auto pos = index.find(node);
+    if (pos != index.end()) return pos->second;
+
+    auto id = static_cast<NodeId>(nodes.size());
+    nodes.push_back(node);
+    index.emplace(node, id);
+
+    return id;
+}
+
+bool ExpressionDag::IsConstant(NodeId id, double value) const
+{
+    return nodes[id].op == Op::Constant && nodes[id].value == value;
+}
+
+// INTERNING
+//---------------------------------
+
+ExpressionDag::NodeId ExpressionDag::MakeConstant(double value)
+{
+    return Intern({ Op::Constant, 0, 0, 0, value });
+}
+
+ExpressionDag::NodeId ExpressionDag::MakeVariable(char pronumeral)
+{
+    return Intern({ Op::Variable, pronumeral, 0, 0, 0 });
+}
+
+ExpressionDag::NodeId ExpressionDag::MakeBinary(Op op, NodeId left, NodeId right)
+{
+    return Intern({ op, 0, left, right, 0 });
+}
+
+ExpressionDag::NodeId ExpressionDag::MakeUnary(Op op, NodeId right)
+{
+    return Intern({ op, 0, 0, right, 0 });
+}
+
+// SIMPLIFYING CONSTRUCTORS
+//---------------------------------
+
+ExpressionDag::NodeId ExpressionDag::Add(NodeId left, NodeId right)
+{
+    if (nodes[left].op == Op::Constant && nodes[right].op == Op::Constant)
+        return MakeConstant(nodes[left].value + nodes[right].value);
+
+    // x+0 -> x
+    if (IsConstant(left, 0)) return right;
+    if (IsConstant(right, 0)) return left;
+
+    return MakeBinary(Op::Plus, left, right);
+}
+
+ExpressionDag::NodeId ExpressionDag::Subtract(NodeId left, NodeId right)
+{
+    if (nodes[left].op == Op::Constant && nodes[right].op == Op::Constant)
+        return MakeConstant(nodes[left].value - nodes[right].value);
+
+    // x-0 -> x, 0-x -> -x
+    if (IsConstant(right, 0)) return left;
+    if (IsConstant(left, 0)) return Negate(right);
+
+    return MakeBinary(Op::Minus, left, right);
+}
+
+ExpressionDag::NodeId ExpressionDag::Multiply(NodeId left, NodeId right)
+{
+    if (nodes[left].op == Op::Constant && nodes[right].op == Op::Constant)
+        return MakeConstant(nodes[left].value * nodes[right].value);
+
+    // x*0 -> 0
+    if (IsConstant(left, 0) || IsConstant(right, 0)) return MakeConstant(0);
+
+    // x*1 -> x
+    if (IsConstant(left, 1)) return right;
+    if (IsConstant(right, 1)) return left;
+
+    return MakeBinary(Op::Multiply, left, right);
+}
+
+ExpressionDag::NodeId ExpressionDag::Divide(NodeId left, NodeId right)
+{
+    if (nodes[left].op == Op::Constant && nodes[right].op == Op::Constant)
+        return MakeConstant(nodes[left].value / nodes[right].value);
+
+    // x/1 -> x
+    if (IsConstant(right, 1)) return left;
+
+    return MakeBinary(Op::Divide, left, right);
+}
+
+ExpressionDag::NodeId ExpressionDag::Power(NodeId left, NodeId right)
+{
+    if (nodes[left].op == Op::Constant && nodes[right].op == Op::Constant)
+        return MakeConstant(std::pow(nodes[left].value, nodes[right].value));
+
+    // x^1 -> x, 1^x -> 1, x^0 -> 1
+    if (IsConstant(right, 1)) return left;
+    if (IsConstant(left, 1) || IsConstant(right, 0)) return MakeConstant(1);
+
+    return MakeBinary(Op::Exponent, left, right);
+}
+
+ExpressionDag::NodeId ExpressionDag::Negate(NodeId right)
+{
+    if (nodes[right].op == Op::Constant)
+        return MakeConstant(-nodes[right].value);
+
+    // --x -> x
+    if (nodes[right].op == Op::UnaryMinus)
+        return nodes[right].right;
+
+    return MakeUnary(Op::UnaryMinus, right);
+}
+
+// CONVERSION
+//---------------------------------
+
+ExpressionDag::NodeId ExpressionDag::Import(const ExpressionBase& expr)
+{
+    auto ImportBinary = [this](Op op, const auto& node) { return MakeBinary(op, Import(node.GetLeft()), Import(node.GetRight())); };
+
+    switch (expr.Kind())
+    {
+    case ExpressionKind::Constant:
+        return MakeConstant(static_cast<const ::Constant&>(expr).GetConstant());
+    case ExpressionKind::Variable:
+        return MakeVariable(static_cast<const ::Variable&>(expr).GetVariable());
+    case ExpressionKind::Plus:
+        return ImportBinary(Op::Plus, static_cast<const OperatorPlus&>(expr));
+    case ExpressionKind::Minus:
+        return ImportBinary(Op::Minus, static_cast<const OperatorMinus&>(expr));
+    case ExpressionKind::Multiply:
+        return ImportBinary(Op::Multiply, static_cast<const OperatorMultiply&>(expr));
+    case ExpressionKind::Divide:
+        return ImportBinary(Op::Divide, static_cast<const OperatorDivide&>(expr));
+    case ExpressionKind::Exponent:
+        return ImportBinary(Op::Exponent, static_cast<const OperatorExponent&>(expr));
+    case ExpressionKind::UnaryMinus:
+        return MakeUnary(Op::UnaryMinus, Import(static_cast<const OperatorUnaryMinus&>(expr).GetRight()));
+    case ExpressionKind::LazyDerivative:
+    {
+        // Differentiated within the DAG rather than expanded as a tree
+        const auto& lazy = static_cast<const ::LazyDerivative&>(expr);
+        return Derivative(Import(lazy.GetOperand()), lazy.GetVariable());
+    }
+    }
+
+    throw std::invalid_argument("Cannot import expression '" + expr.Print() + "' into a DAG");
+}
+
+std::unique_ptr<ExpressionBase> ExpressionDag::Export(NodeId id) const
+{
+    const auto& node = nodes[id];
+
+    switch (node.op)
+    {
+    case Op::Constant:
+        return std::make_unique<::Constant>(node.value);
+    case Op::Variable:
+        return std::make_unique<::Variable>(node.variable);
+    case Op::Plus:
+        return std::make_unique<OperatorPlus>(Export(node.left), Export(node.right));
+    case Op::Minus:
+        return std::make_unique<OperatorMinus>(Export(node.left), Export(node.right));
+    case Op::Multiply:
+        return std::make_unique<OperatorMultiply>(Export(node.left), Export(node.right));
+    case Op::Divide:
+        return std::make_unique<OperatorDivide>(Export(node.left), Export(node.right));
+    case Op::Exponent:
+        return std::make_unique<OperatorExponent>(Export(node.left), Export(node.right));
+    case Op::UnaryMinus:
+        return std::make_unique<OperatorUnaryMinus>(Export(node.right));
+    }
+
+    throw std::invalid_argument("Cannot export unknown DAG node");
+}
+
+std::string ExpressionDag::Print(NodeId id) const
+{
+    return Export(id)->Print();
+}
+
+std::string ExpressionDag::PrintWithTemporaries(NodeId root) const
+{
+    auto reachable = Reachable(root);
+
+    std::vector<uint32_t> uses(root + 1, 0);
+    std::unordered_set<char> variables;
+
+    for (auto id : reachable)
+    {
+        const auto& node = nodes[id];
+
+        if (node.op == Op::Variable)
+            variables.insert(node.variable);
+        else if (node.op == Op::UnaryMinus)
+            uses[node.right]++;
+        else if (node.op != Op::Constant)
+            uses[node.left]++, uses[node.right]++;
+    }
+
+    char letter = 't';
+    for (char candidate = 'a'; variables.count(letter) && candidate <= 'z'; candidate++)
+        letter = candidate;
+
+    if (variables.count(letter))
+        throw std::invalid_argument("Cannot print with temporaries: every letter is a variable");
+
+    // As ExpressionBase::Priority, a temporary binds like a variable
+    struct Printed
+    {
+        std::string text;
+        int priority;
+    };
+
+    std::vector<Printed> printed(root + 1);
+    std::string bindings;
+    size_t temporaries = 0;
+
+    auto IsTemporary = [letter](const std::string& text) { return !text.empty() && text.front() == letter; };
+
+    auto EndsWithTemporary = [letter](const std::string& text)
+    {
+        auto digits = text.find_last_not_of("0123456789");
+        return digits != std::string::npos && digits + 1 < text.size() && text[digits] == letter;
+    };
+
+    // The same parenthesization as BinaryOperator::PrintBinary
+    auto PrintBinary = [&printed](NodeId l, NodeId r, const std::string& op, int priority, bool leftAssosiative) -> Printed
+    {
+        const auto& lhs = printed[l];
+        const auto& rhs = printed[r];
+
+        std::string str;
+
+        auto PrintOperand = [&str](const Printed& operand, bool parenthesize)
+        {
+            if (parenthesize) str += '(';
+            str += operand.text;
+            if (parenthesize) str += ')';
+        };
+
+        PrintOperand(lhs, leftAssosiative ? lhs.priority < priority : lhs.priority <= priority);
+        str += op;
+        PrintOperand(rhs, leftAssosiative ? rhs.priority <= priority : rhs.priority < priority);
+
+        return { str, priority };
+    };
+
+    // As in OperatorMultiply::PrintTo, a juxtaposed number or sign would misread
+    auto NeedsOperator = [this, &uses](NodeId id)
+    {
+        if (nodes[id].op == Op::UnaryMinus)
+            return true;
+
+        if (nodes[id].op == Op::Exponent && uses[id] < 2)
+            id = nodes[id].left;
+
+        return nodes[id].op == Op::Constant;
+    };
+
+    for (auto id : reachable)
+    {
+        const auto& node = nodes[id];
+        auto& result = printed[id];
+
+        switch (node.op)
+        {
+        case Op::Constant:
+            // A negative constant binds like a unary minus, as in ExpressionBase::Priority
+            result = { {}, std::signbit(node.value) ? 3 : 10 };
+            ::Constant::Format(node.value, result.text);
+            break;
+        case Op::Variable:
+            result = { std::string(1, node.variable), 10 };
+            break;
+        case Op::Plus:
+            result = PrintBinary(node.left, node.right, "+", 1, true);
+            break;
+        case Op::Minus:
+            result = PrintBinary(node.left, node.right, "-", 1, true);
+            break;
+        case Op::Multiply:
+        {
+            // As OperatorMultiply::Print, plus a "*" wherever a temporary would run into its neighbour
+            if (nodes[node.left].op == Op::Variable && nodes[node.right].op == Op::Constant)
+                result = PrintBinary(node.right, node.left, "", 2, true);
+            else if (NeedsOperator(node.right) || EndsWithTemporary(printed[node.left].text) || IsTemporary(printed[node.right].text))
+                result = PrintBinary(node.left, node.right, "*", 2, true);
+            else
+                result = PrintBinary(node.left, node.right, "", 2, true);
+            break;
+        }
+        case Op::Divide:
+            result = PrintBinary(node.left, node.right, "/", 2, true);
+            break;
+        case Op::Exponent:
+            result = PrintBinary(node.left, node.right, "^", 4, false);
+            break;
+        case Op::UnaryMinus:
+        {
+            const auto& operand = printed[node.right];
+            result = { operand.priority <= 3 ? "-(" + operand.text + ")" : "-" + operand.text, 3 };
+            break;
+        }
+        }
+
+        if (uses[id] >= 2 && node.op != Op::Constant && node.op != Op::Variable)
+        {
+            auto name = letter + std::to_string(++temporaries);
+            bindings += name + " = " + result.text + "; ";
+            result = { name, 10 };
+        }
+    }
+
+    return bindings + printed[root].text;
+}
+
+std::vector<ExpressionDag::NodeId> ExpressionDag::Reachable(NodeId root) const
+{
+    std::vector<bool> seen(root + 1, false);
+    seen[root] = true;
+
+    // Children always have smaller ids, so one descending sweep marks everything
+    for (NodeId id = root + 1; id-- > 0;)
+    {
+        if (!seen[id]) continue;
+
+        const auto& node = nodes[id];
+
+        if (node.op == Op::UnaryMinus)
+            seen[node.right] = true;
+        else if (node.op != Op::Constant && node.op != Op::Variable)
+            seen[node.left] = seen[node.right] = true;
+    }
+
+    std::vector<NodeId> reachable;
+
+    for (NodeId id = 0; id <= root; id++)
+        if (seen[id])
+            reachable.push_back(id);
+
+    return reachable;
+}
+
+// EVALUATE
+//---------------------------------
+
+std::optional<double> ExpressionDag::Evaluate(NodeId id, const std::unordered_map<char, double>& values) const
+{
+    std::vector<double> results(id + 1);
+
+    for (auto current : Reachable(id))
+    {
+        const auto& node = nodes[current];
+        auto& result = results[current];
+
+        switch (node.op)
+        {
+        case Op::Constant:
+        {
+            result = node.value;
+            break;
+        }
+        case Op::Variable:
+        {
+            auto pos = values.find(node.variable);
+            if (pos == values.end()) return std::nullopt;
+            result = pos->second;
+            break;
+        }
+        case Op::Plus:
+            result = results[node.left] + results[node.right];
+            break;
+        case Op::Minus:
+            result = results[node.left] - results[node.right];
+            break;
+        case Op::Multiply:
+            result = results[node.left] * results[node.right];
+            break;
+        case Op::Divide:
+            result = results[node.left] / results[node.right];
+            break;
+        case Op::Exponent:
+            result = std::pow(results[node.left], results[node.right]);
+            break;
+        case Op::UnaryMinus:
+            result = -results[node.right];
+            break;
+        }
+    }
+
+    return results[id];
+}
+
+std::optional<std::vector<double>> ExpressionDag::TaylorCoefficients(NodeId id, char wrt, const std::unordered_map<char, double>& values, size_t order) const
+{
+    const auto size = order + 1;
+    std::vector<Taylor> results(id + 1);
+
+    for (auto current : Reachable(id))
+    {
+        const auto& node = nodes[current];
+        auto& result = results[current];
+
+        switch (node.op)
+        {
+        case Op::Constant:
+        {
+            result = Taylor::Constant(node.value, size);
+            break;
+        }
+        case Op::Variable:
+        {
+            auto pos = values.find(node.variable);
+            if (pos == values.end()) return std::nullopt;
+            result = Taylor::Constant(pos->second, size);
+            if (node.variable == wrt && size > 1) result[1] = 1;
+            break;
+        }
+        case Op::Plus:
+            result = results[node.left] + results[node.right];
+            break;
+        case Op::Minus:
+            result = results[node.left] - results[node.right];
+            break;
+        case Op::Multiply:
+            result = results[node.left] * results[node.right];
+            break;
+        case Op::Divide:
+            result = results[node.left] / results[node.right];
+            break;
+        case Op::Exponent:
+            result = ::Power(results[node.left], results[node.right]);
+            break;
+        case Op::UnaryMinus:
+            result = -results[node.right];
+            break;
+        }
+    }
+
+    return std::move(results[id].coefficients);
+}
+
+// DERIVATIVE
+//---------------------------------
+
+ExpressionDag::NodeId ExpressionDag::Derivative(NodeId id, char wrt)
+{
+    auto key = (static_cast<uint64_t>(id) << 8) | static_cast<unsigned char>(wrt);
+
+    auto pos = derivatives.find(key);
+    if (pos != derivatives.end()) return pos->second;
+
+    // Copy, as interning new nodes can reallocate the node storage
+    const auto node = nodes[id];
+    NodeId result = 0;
+
+    // These mirror the rules of the ExpressionBase::Derivative overrides, but reference
+    // the operands by id rather than cloning them
+
+    switch (node.op)
+    {
+    case Op::Constant:
+        result = MakeConstant(0);
+        break;
+    case Op::Variable:
+        result = MakeConstant(node.variable == wrt ? 1 : 0);
+        break;
+    case Op::Plus:
+        result = Add(Derivative(node.left, wrt), Derivative(node.right, wrt));
+        break;
+    case Op::Minus:
+        result = Subtract(Derivative(node.left, wrt), Derivative(node.right, wrt));
+        break;
+    case Op::Multiply:
+        result = Add(
+            Multiply(node.left, Derivative(node.right, wrt)),
+            Multiply(node.right, Derivative(node.left, wrt)));
+        break;
+    case Op::Divide:
+        result = Divide(
+            Subtract(
+                Multiply(node.right, Derivative(node.left, wrt)),
+                Multiply(node.left, Derivative(node.right, wrt))),
+            Power(node.right, MakeConstant(2)));
+        break;
+    case Op::Exponent:
+        result = Multiply(
+            node.right,
+            Multiply(
+                Derivative(node.left, wrt),
+                Power(node.left, Subtract(node.right, MakeConstant(1)))));
+        break;
+    case Op::UnaryMinus:
+        result = Negate(Derivative(node.right, wrt));
+        break;
+    }
+
+    derivatives.emplace(key, result);
+    return result;
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include "Expression.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// An immutable store of hash-consed expression nodes. Every structurally identical
+// subexpression is interned exactly once and referred to by a NodeId, so the derivative
+// rules can reference existing subtrees instead of cloning them. A node's children always
+// have smaller ids than the node itself, so ids are in topological order.
+
+class ExpressionDag
+{
+public:
+	using NodeId = uint32_t;
+
+	// The operator kinds of ExpressionKind, lazy derivatives are differentiated on import
+	// rather than becoming a node
+	enum class Op : uint8_t
+	{
+		Constant,
+		Variable,
+		Plus,
+		Minus,
+		Multiply,
+		Divide,
+		Exponent,
+		UnaryMinus,
+	};
+
+	struct Node
+	{
+		Op op;
+		char variable;
+		NodeId left;
+		NodeId right;
+		double value;
+
+		bool operator==(const Node& other) const;
+	};
+
+	// Interns a node exactly as given
+	NodeId MakeConstant(double value);
+	NodeId MakeVariable(char pronumeral);
+	NodeId MakeBinary(Op op, NodeId left, NodeId right);
+	NodeId MakeUnary(Op op, NodeId right);
+
+	// Interns a node after applying local simplifications (constant folding, x+0, x*1, ...)
+	NodeId Add(NodeId left, NodeId right);
+	NodeId Subtract(NodeId left, NodeId right);
+	NodeId Multiply(NodeId left, NodeId right);
+	NodeId Divide(NodeId left, NodeId right);
+	NodeId Power(NodeId left, NodeId right);
+	NodeId Negate(NodeId right);
+
+	NodeId Import(const ExpressionBase& expr);
+	std::unique_ptr<ExpressionBase> Export(NodeId id) const;
+
+	// Derivatives are memoized per (node, wrt), so shared subexpressions are only differentiated once
+	NodeId Derivative(NodeId id, char wrt);
+
+	std::optional<double> Evaluate(NodeId id, const std::unordered_map<char, double>& values = {}) const;
+	// Coefficients 0 to order of the Taylor series in wrt about values, coefficient k being the kth
+	// derivative over k!. Propagated through the nodes as truncated series, see Taylor.h, so no
+	// derivative nodes are built.
+	std::optional<std::vector<double>> TaylorCoefficients(NodeId id, char wrt, const std::unordered_map<char, double>& values, size_t order) const;
+	std::string Print(NodeId id) const;
+	// Binds every operator node used more than once to a temporary, "t1 = x+1; t2 = t1^2; t2/(t2+y)".
+	// The temporaries are named after a letter that isn't a variable of the expression.
+	std::string PrintWithTemporaries(NodeId root) const;
+
+	const Node& GetNode(NodeId id) const { return nodes[id]; }
+	size_t Size() const { return nodes.size(); }
+
+	// All nodes reachable from root, in ascending (topological) order
+	std::vector<NodeId> Reachable(NodeId root) const;
+
+private:
+	struct NodeHash
+	{
+		size_t operator()(const Node& node) const;
+	};
+
+	NodeId Intern(const Node& node);
+	bool IsConstant(NodeId id, double value) const;
+
+	std::vector<Node> nodes;
+	std::unordered_map<Node, NodeId, NodeHash> index;
+	std::unordered_map<uint64_t, NodeId> derivatives;
+};
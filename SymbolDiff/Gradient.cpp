@@ -0,0 +1,180 @@
+#include "Gradient.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+GradientTape::GradientTape(const ExpressionBase& expr)
+{
+    auto set = expr.GetSetOfAllSubVariables();
+
+    variables.assign(set.begin(), set.end());
+    std::sort(variables.begin(), variables.end());
+
+    Record(expr);
+}
+
+void GradientTape::Record(const ExpressionBase& expr)
+{
+    // Recording goes through a DAG, so a repeated subexpression gets a single entry whose
+    // adjoint accumulates every use. Entries are recorded children first, so the root is last
+    // and walking the tape backwards visits every node before any of its operands
+
+    ExpressionDag dag;
+    auto root = dag.Import(expr);
+
+    std::vector<uint32_t> entryOf(root + 1, 0);
+
+    for (auto id : dag.Reachable(root))
+    {
+        const auto& node = dag.GetNode(id);
+        Entry entry{ node.op, false, 0, 0, 0 };
+
+        switch (node.op)
+        {
+        case OpCode::Constant:
+            entry.constant = node.value;
+            break;
+        case OpCode::Variable:
+            entry.dependsOnVariables = true;
+            entry.left = static_cast<uint32_t>(std::distance(variables.begin(), std::find(variables.begin(), variables.end(), node.variable)));
+            break;
+        case OpCode::UnaryMinus:
+            entry.right = entryOf[node.right];
+            entry.dependsOnVariables = entries[entry.right].dependsOnVariables;
+            break;
+        default:
+            entry.left = entryOf[node.left];
+            entry.right = entryOf[node.right];
+            entry.dependsOnVariables = entries[entry.left].dependsOnVariables || entries[entry.right].dependsOnVariables;
+            break;
+        }
+
+        entryOf[id] = static_cast<uint32_t>(entries.size());
+        entries.push_back(entry);
+    }
+}
+
+double GradientTape::Evaluate(const double* slots, double* gradient) const
+{
+    std::vector<double> values(entries.size());
+    std::vector<double> adjoints(entries.size(), 0.0);
+
+    // Forward sweep
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const auto& entry = entries[i];
+
+        switch (entry.op)
+        {
+        case OpCode::Constant:
+            values[i] = entry.constant;
+            break;
+        case OpCode::Variable:
+            values[i] = slots[entry.left];
+            break;
+        case OpCode::Plus:
+            values[i] = values[entry.left] + values[entry.right];
+            break;
+        case OpCode::Minus:
+            values[i] = values[entry.left] - values[entry.right];
+            break;
+        case OpCode::Multiply:
+            values[i] = values[entry.left] * values[entry.right];
+            break;
+        case OpCode::Divide:
+            values[i] = values[entry.left] / values[entry.right];
+            break;
+        case OpCode::Exponent:
+            values[i] = std::pow(values[entry.left], values[entry.right]);
+            break;
+        case OpCode::UnaryMinus:
+            values[i] = -values[entry.right];
+            break;
+        }
+    }
+
+    std::fill(gradient, gradient + variables.size(), 0.0);
+
+    if (entries.empty()) return 0;
+
+    // Backward sweep
+    adjoints.back() = 1;
+
+    for (size_t i = entries.size(); i-- > 0;)
+    {
+        const auto& entry = entries[i];
+        const auto adjoint = adjoints[i];
+
+        // Constant subtrees don't contribute, and skipping zero adjoints avoids turning
+        // 0 * inf (e.g from x^-1 at x = 0 in an unused branch) into a NaN
+        if (adjoint == 0 || !entry.dependsOnVariables) continue;
+
+        if (entry.op == OpCode::Variable)
+        {
+            gradient[entry.left] += adjoint;
+            continue;
+        }
+
+        const auto l = values[entry.left];
+        const auto r = values[entry.right];
+
+        switch (entry.op)
+        {
+        case OpCode::Constant:
+        case OpCode::Variable:
+            break;
+        case OpCode::Plus:
+            adjoints[entry.left] += adjoint;
+            adjoints[entry.right] += adjoint;
+            break;
+        case OpCode::Minus:
+            adjoints[entry.left] += adjoint;
+            adjoints[entry.right] -= adjoint;
+            break;
+        case OpCode::Multiply:
+            adjoints[entry.left] += adjoint * r;
+            adjoints[entry.right] += adjoint * l;
+            break;
+        case OpCode::Divide:
+            adjoints[entry.left] += adjoint / r;
+            adjoints[entry.right] -= adjoint * values[i] / r;
+            break;
+        case OpCode::Exponent:
+            // d(a^b) = b a^(b-1) da + a^b ln(a) db, the second term only matters if b varies
+            if (entries[entry.left].dependsOnVariables)
+                adjoints[entry.left] += adjoint * r * std::pow(l, r - 1);
+            if (entries[entry.right].dependsOnVariables)
+                adjoints[entry.right] += adjoint * values[i] * std::log(l);
+            break;
+        case OpCode::UnaryMinus:
+            adjoints[entry.right] -= adjoint;
+            break;
+        }
+    }
+
+    return values.back();
+}
+
+std::optional<GradientResult> EvaluateGradient(const ExpressionBase& expr, const std::unordered_map<char, double>& values)
+{
+    GradientTape tape(expr);
+
+    std::vector<double> slots;
+    slots.reserve(tape.Variables().size());
+
+    for (auto variable : tape.Variables())
+    {
+        auto pos = values.find(variable);
+        if (pos == values.end()) return std::nullopt;
+        slots.push_back(pos->second);
+    }
+
+    std::vector<double> gradient(slots.size());
+    GradientResult result{ tape.Evaluate(slots.data(), gradient.data()), {} };
+
+    for (size_t i = 0; i < gradient.size(); i++)
+        result.partials[tape.Variables()[i]] = gradient[i];
+
+    return result;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "CompiledExpression.h"
+
+// Reverse mode automatic differentiation. The expression is recorded once as a tape of its
+// distinct nodes, then each evaluation is one forward sweep computing every node's value and one
+// backward sweep accumulating the adjoints, giving the value and every partial derivative.
+
+class GradientTape
+{
+public:
+	explicit GradientTape(const ExpressionBase& expr);
+
+	// slots and gradient are both in Variables() order
+	double Evaluate(const double* slots, double* gradient) const;
+
+	const std::vector<char>& Variables() const { return variables; }
+
+private:
+	using OpCode = CompiledExpression::OpCode;
+
+	struct Entry
+	{
+		OpCode op;
+		bool dependsOnVariables;
+		uint32_t left;		// Variable: the slot to read
+		uint32_t right;
+		double constant;
+	};
+
+	void Record(const ExpressionBase& expr);
+
+	std::vector<Entry> entries;
+	std::vector<char> variables;
+};
+
+struct GradientResult
+{
+	double value;
+	std::unordered_map<char, double> partials;
+};
+
+// Returns nullopt if a variable of the expression has no value
+std::optional<GradientResult> EvaluateGradient(const ExpressionBase& expr, const std::unordered_map<char, double>& values);
@@ -0,0 +1,80 @@
+#include "Instrumentation.h"
+
+namespace
+{
+    thread_local Instrumentation* currentInstrumentation = nullptr;
+}
+
+Instrumentation::Counters& Instrumentation::Counters::operator+=(const Counters& other)
+{
+    nodesAllocated += other.nodesAllocated;
+    nodesCloned += other.nodesCloned;
+    simplifyPasses += other.simplifyPasses;
+
+    for (size_t stage = 0; stage < stageTimes.size(); stage++)
+        stageTimes[stage] += other.stageTimes[stage];
+
+    return *this;
+}
+
+Instrumentation::Counters Instrumentation::Totals() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+}
+
+void Instrumentation::Reset()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    counters = {};
+}
+
+void Instrumentation::Add(const Counters& other)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    counters += other;
+}
+
+std::string Instrumentation::StageName(Stage stage)
+{
+    switch (stage)
+    {
+    case Stage::Tokenize: return "Tokenize";
+    case Stage::Parse: return "Parse";
+    case Stage::Derivative: return "Derivative";
+    case Stage::Simplify: return "Simplify";
+    case Stage::Print: return "Print";
+    default: return "Unknown";
+    }
+}
+
+Instrumentation* Instrumentation::Current()
+{
+    return currentInstrumentation;
+}
+
+Instrumentation::Scope::Scope(Instrumentation& instrumentation) :
+    previous(currentInstrumentation)
+{
+    currentInstrumentation = &instrumentation;
+}
+
+Instrumentation::Scope::~Scope()
+{
+    currentInstrumentation = previous;
+}
+
+Instrumentation::StageTimer::StageTimer(Stage stage) :
+    instrumentation(currentInstrumentation),
+    stage(stage)
+{
+    // Nothing to time without an instrumentation to add it to
+    if (instrumentation)
+        start = std::chrono::steady_clock::now();
+}
+
+Instrumentation::StageTimer::~StageTimer()
+{
+    if (instrumentation)
+        instrumentation->counters.TimeOf(stage) += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+}
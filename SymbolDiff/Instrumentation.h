@@ -0,0 +1,123 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <string>
+
+// Counters for finding out where a call spends its work: nodes allocated and cloned, simplifier
+// passes and the time spent in each stage of Differentiate. While a Scope is active on a thread,
+// what that thread does is added to its Instrumentation. DifferentiateBatch adds the work of every
+// input to the caller's, and also reports each input's counters on its own in its result.
+//
+// Recording is compiled in only when SYMBOLDIFF_INSTRUMENTATION is defined, for the library and
+// everything including its headers alike, as the Debug configuration does. Otherwise the library
+// headers don't include this one, the recording macros below expand to nothing so the hooks cost
+// nothing, and every counter stays 0.
+
+class Instrumentation
+{
+public:
+#ifdef SYMBOLDIFF_INSTRUMENTATION
+	static constexpr bool enabled = true;
+#else
+	static constexpr bool enabled = false;
+#endif
+
+	enum class Stage
+	{
+		Tokenize,
+		Parse,
+		Derivative,
+		Simplify,
+		Print,
+		Count,
+	};
+
+	struct Counters
+	{
+		size_t nodesAllocated = 0;
+		size_t nodesCloned = 0;
+		size_t simplifyPasses = 0;
+		std::array<std::chrono::nanoseconds, static_cast<size_t>(Stage::Count)> stageTimes = {};
+
+		std::chrono::nanoseconds& TimeOf(Stage stage) { return stageTimes[static_cast<size_t>(stage)]; }
+		std::chrono::nanoseconds TimeOf(Stage stage) const { return stageTimes[static_cast<size_t>(stage)]; }
+
+		Counters& operator+=(const Counters& other);
+	};
+
+	Instrumentation() = default;
+
+	Instrumentation(const Instrumentation&) = delete;
+	Instrumentation& operator=(const Instrumentation&) = delete;
+
+	// Everything recorded since construction or the last Reset()
+	Counters Totals() const;
+	void Reset();
+
+	// Locks, so several threads can merge their work into one instrumentation at once
+	void Add(const Counters& counters);
+
+	static std::string StageName(Stage stage);
+
+	// The instrumentation recording the work of this thread, or nullptr
+	static Instrumentation* Current();
+
+	class Scope
+	{
+	public:
+		explicit Scope(Instrumentation& instrumentation);
+		~Scope();
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+	private:
+		Instrumentation* previous;
+	};
+
+	// Adds the time from construction to destruction to a stage of the current instrumentation
+	class StageTimer
+	{
+	public:
+		explicit StageTimer(Stage stage);
+		~StageTimer();
+
+		StageTimer(const StageTimer&) = delete;
+		StageTimer& operator=(const StageTimer&) = delete;
+
+	private:
+		Instrumentation* instrumentation;
+		Stage stage;
+		std::chrono::steady_clock::time_point start;
+	};
+
+	static void Increment(size_t Counters::* counter)
+	{
+		if (auto instrumentation = Current())
+			instrumentation->counters.*counter += 1;
+	}
+
+	template <typename F>
+	static auto Timed(Stage stage, F f)
+	{
+		StageTimer timer(stage);
+		return f();
+	}
+
+private:
+	// Recording from the thread of the active scope updates the counters without locking
+	mutable std::mutex mutex;
+	Counters counters;
+};
+
+#ifdef SYMBOLDIFF_INSTRUMENTATION
+// Adds 1 to a field of Instrumentation::Counters
+#define SYMBOLDIFF_COUNT(counter) Instrumentation::Increment(&Instrumentation::Counters::counter)
+// Evaluates the expression, adding the time it takes to an Instrumentation::Stage
+#define SYMBOLDIFF_TIMED(stage, ...) Instrumentation::Timed(Instrumentation::Stage::stage, [&] { return __VA_ARGS__; })
+#else
+#define SYMBOLDIFF_COUNT(counter) ((void)0)
+#define SYMBOLDIFF_TIMED(stage, ...) (__VA_ARGS__)
+#endif
@@ -0,0 +1,75 @@
+#include "Jacobian.h"
+#include "ExpressionDag.h"
+#include "Rewrite.h"
+
+SystemDerivatives DifferentiateSystem(const std::vector<std::unique_ptr<ExpressionBase>>& expressions, const std::vector<char>& variables, bool hessians)
+{
+    SystemDerivatives result;
+    ExpressionDag dag;
+
+    // Differentiating with respect to a variable that doesn't occur gives a structural zero
+    auto Differentiate = [&dag, &variables](ExpressionDag::NodeId id, const std::unordered_set<char>& occurring, size_t j) -> std::unique_ptr<ExpressionBase>
+    {
+        if (!occurring.count(variables[j]))
+            return nullptr;
+
+        return RewriteEngine().Rewrite(dag.Export(dag.Derivative(id, variables[j])));
+    };
+
+    result.jacobian.resize(expressions.size());
+    if (hessians) result.hessians.resize(expressions.size());
+
+    for (size_t i = 0; i < expressions.size(); i++)
+    {
+        auto id = dag.Import(*expressions[i]);
+        auto occurring = expressions[i]->GetSetOfAllSubVariables();
+
+        auto& row = result.jacobian[i];
+        row.resize(variables.size());
+
+        for (size_t j = 0; j < variables.size(); j++)
+            row[j] = Differentiate(id, occurring, j);
+
+        if (!hessians) continue;
+
+        auto& hessian = result.hessians[i];
+        hessian.resize(variables.size());
+
+        for (auto& entries : hessian)
+            entries.resize(variables.size());
+
+        // Second derivatives come from the simplified first ones, imported back so they share
+        // nodes with the rest of the system. Only the upper triangle is differentiated, the
+        // lower is mirrored from it.
+        for (size_t j = 0; j < variables.size(); j++)
+        {
+            if (!row[j]) continue;
+
+            auto first = dag.Import(*row[j]);
+            auto firstOccurring = row[j]->GetSetOfAllSubVariables();
+
+            for (size_t k = j; k < variables.size(); k++)
+            {
+                hessian[j][k] = Differentiate(first, firstOccurring, k);
+
+                if (k != j && hessian[j][k])
+                    hessian[k][j] = hessian[j][k]->Clone();
+            }
+        }
+    }
+
+    return result;
+}
+
+ExpressionMatrix Jacobian(const std::vector<std::unique_ptr<ExpressionBase>>& expressions, const std::vector<char>& variables)
+{
+    return DifferentiateSystem(expressions, variables).jacobian;
+}
+
+ExpressionMatrix Hessian(const ExpressionBase& expr, const std::vector<char>& variables)
+{
+    std::vector<std::unique_ptr<ExpressionBase>> expressions;
+    expressions.push_back(expr.Clone());
+
+    return std::move(DifferentiateSystem(expressions, variables, true).hessians.front());
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include "Expression.h"
+
+#include <vector>
+
+// Symbolic derivatives of a system of expressions with respect to a list of variables. The
+// whole system is differentiated within one ExpressionDag, so a subexpression shared between
+// entries (or between expressions) is only differentiated once, and an entry is skipped without
+// any work when its expression doesn't contain the variable.
+
+// Entry [i][j] is the derivative of expression i by variable j, simplified, or nullptr where
+// it is a structural zero
+using ExpressionMatrix = std::vector<std::vector<std::unique_ptr<ExpressionBase>>>;
+
+struct SystemDerivatives
+{
+	ExpressionMatrix jacobian;
+	// hessians[i][j][k] is the derivative of expression i by variables j and k, empty unless requested
+	std::vector<ExpressionMatrix> hessians;
+};
+
+SystemDerivatives DifferentiateSystem(const std::vector<std::unique_ptr<ExpressionBase>>& expressions, const std::vector<char>& variables, bool hessians = false);
+
+ExpressionMatrix Jacobian(const std::vector<std::unique_ptr<ExpressionBase>>& expressions, const std::vector<char>& variables);
+ExpressionMatrix Hessian(const ExpressionBase& expr, const std::vector<char>& variables);
@@ -0,0 +1,286 @@
+#include "JitExpression.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#if defined(_WIN32)
+#define JIT_X64
+#define JIT_WINDOWS
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#define JIT_X64
+#include <sys/mman.h>
+#endif
+#endif
+
+#ifdef JIT_X64
+namespace
+{
+    using OpCode = CompiledExpression::OpCode;
+
+    double Power(double base, double exponent)
+    {
+        return std::pow(base, exponent);
+    }
+
+    // Generated code layout:
+    //
+    //   push rbx                   ; rbx holds the slot array, it's callee saved in both ABIs
+    //   mov rbx, rdi / rcx
+    //   sub rsp, frame             ; rsp is now 16 byte aligned for calls to pow
+    //   ...                        ; register i lives at [rsp + 32 + 8 * i], below it is the
+    //                              ; shadow space the Windows ABI requires for calls
+    //   movsd xmm0, [result]
+    //   add rsp, frame
+    //   pop rbx
+    //   ret
+
+    class Assembler
+    {
+    public:
+        std::vector<unsigned char> code;
+
+        void Bytes(std::initializer_list<unsigned char> bytes)
+        {
+            code.insert(code.end(), bytes);
+        }
+
+        void Imm32(uint32_t value)
+        {
+            for (int i = 0; i < 4; i++)
+                code.push_back(static_cast<unsigned char>(value >> (8 * i)));
+        }
+
+        void Imm64(uint64_t value)
+        {
+            for (int i = 0; i < 8; i++)
+                code.push_back(static_cast<unsigned char>(value >> (8 * i)));
+        }
+
+        // movsd xmm, [rsp + offset]
+        void LoadRegister(int xmm, uint32_t offset)
+        {
+            Bytes({ 0xF2, 0x0F, 0x10, static_cast<unsigned char>(0x84 | (xmm << 3)), 0x24 });
+            Imm32(offset);
+        }
+
+        // movsd [rsp + offset], xmm0
+        void StoreRegister(uint32_t offset)
+        {
+            Bytes({ 0xF2, 0x0F, 0x11, 0x84, 0x24 });
+            Imm32(offset);
+        }
+
+        // addsd/subsd/mulsd/divsd xmm0, [rsp + offset]
+        void Arithmetic(unsigned char opcode, uint32_t offset)
+        {
+            Bytes({ 0xF2, 0x0F, opcode, 0x84, 0x24 });
+            Imm32(offset);
+        }
+
+        // movsd xmm0, [rbx + offset]
+        void LoadSlot(uint32_t offset)
+        {
+            Bytes({ 0xF2, 0x0F, 0x10, 0x83 });
+            Imm32(offset);
+        }
+
+        // mov rax, value
+        void MoveRax(uint64_t value)
+        {
+            Bytes({ 0x48, 0xB8 });
+            Imm64(value);
+        }
+
+        // mov [rsp + offset], rax
+        void StoreRax(uint32_t offset)
+        {
+            Bytes({ 0x48, 0x89, 0x84, 0x24 });
+            Imm32(offset);
+        }
+    };
+
+    uint32_t RegisterOffset(uint32_t reg)
+    {
+        return 32 + 8 * reg;
+    }
+
+    std::vector<unsigned char> Generate(const CompiledExpression& compiled)
+    {
+        Assembler a;
+
+        auto frame = RegisterOffset(compiled.RegisterCount());
+        frame = (frame + 15) & ~15u;
+
+        a.Bytes({ 0x53 });                  // push rbx
+#ifdef JIT_WINDOWS
+        a.Bytes({ 0x48, 0x89, 0xCB });      // mov rbx, rcx
+#else
+        a.Bytes({ 0x48, 0x89, 0xFB });      // mov rbx, rdi
+#endif
+        a.Bytes({ 0x48, 0x81, 0xEC });      // sub rsp, frame
+        a.Imm32(frame);
+
+        // Exponents known to be 2 are squared inline rather than calling pow
+        std::vector<bool> registerIsTwo(compiled.RegisterCount(), false);
+
+        for (const auto& instruction : compiled.Instructions())
+        {
+            auto destination = RegisterOffset(instruction.destination);
+            auto left = RegisterOffset(instruction.left);
+            auto right = RegisterOffset(instruction.right);
+
+            switch (instruction.op)
+            {
+            case OpCode::Constant:
+            {
+                uint64_t bits;
+                std::memcpy(&bits, &instruction.constant, sizeof(bits));
+                a.MoveRax(bits);
+                a.StoreRax(destination);
+                break;
+            }
+            case OpCode::Variable:
+                a.LoadSlot(8 * instruction.left);
+                a.StoreRegister(destination);
+                break;
+            case OpCode::Plus:
+                a.LoadRegister(0, left);
+                a.Arithmetic(0x58, right);
+                a.StoreRegister(destination);
+                break;
+            case OpCode::Minus:
+                a.LoadRegister(0, left);
+                a.Arithmetic(0x5C, right);
+                a.StoreRegister(destination);
+                break;
+            case OpCode::Multiply:
+                a.LoadRegister(0, left);
+                a.Arithmetic(0x59, right);
+                a.StoreRegister(destination);
+                break;
+            case OpCode::Divide:
+                a.LoadRegister(0, left);
+                a.Arithmetic(0x5E, right);
+                a.StoreRegister(destination);
+                break;
+            case OpCode::Exponent:
+                a.LoadRegister(0, left);
+
+                if (registerIsTwo[instruction.right])
+                {
+                    a.Bytes({ 0xF2, 0x0F, 0x59, 0xC0 });                    // mulsd xmm0, xmm0
+                }
+                else
+                {
+                    a.LoadRegister(1, right);
+                    a.MoveRax(reinterpret_cast<uint64_t>(&Power));
+                    a.Bytes({ 0xFF, 0xD0 });                                // call rax
+                }
+
+                a.StoreRegister(destination);
+                break;
+            case OpCode::UnaryMinus:
+                a.LoadRegister(0, right);
+                a.MoveRax(0x8000000000000000ull);
+                a.Bytes({ 0x66, 0x48, 0x0F, 0x6E, 0xC8 });                  // movq xmm1, rax
+                a.Bytes({ 0x66, 0x0F, 0x57, 0xC1 });                        // xorpd xmm0, xmm1
+                a.StoreRegister(destination);
+                break;
+            }
+
+            registerIsTwo[instruction.destination] = instruction.op == OpCode::Constant && instruction.constant == 2;
+        }
+
+        a.LoadRegister(0, RegisterOffset(compiled.ResultRegister()));
+        a.Bytes({ 0x48, 0x81, 0xC4 });      // add rsp, frame
+        a.Imm32(frame);
+        a.Bytes({ 0x5B, 0xC3 });            // pop rbx; ret
+
+        return a.code;
+    }
+
+    void* AllocateExecutable(const std::vector<unsigned char>& code)
+    {
+        // Written while writable, then flipped to executable so the page is never both
+#ifdef JIT_WINDOWS
+        void* memory = VirtualAlloc(nullptr, code.size(), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+        if (!memory) return nullptr;
+
+        std::memcpy(memory, code.data(), code.size());
+
+        DWORD old;
+        if (!VirtualProtect(memory, code.size(), PAGE_EXECUTE_READ, &old))
+        {
+            VirtualFree(memory, 0, MEM_RELEASE);
+            return nullptr;
+        }
+
+        FlushInstructionCache(GetCurrentProcess(), memory, code.size());
+        return memory;
+#else
+        void* memory = mmap(nullptr, code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) return nullptr;
+
+        std::memcpy(memory, code.data(), code.size());
+
+        if (mprotect(memory, code.size(), PROT_READ | PROT_EXEC) != 0)
+        {
+            munmap(memory, code.size());
+            return nullptr;
+        }
+
+        return memory;
+#endif
+    }
+
+    void FreeExecutable(void* memory, size_t size)
+    {
+#ifdef JIT_WINDOWS
+        VirtualFree(memory, 0, MEM_RELEASE);
+#else
+        munmap(memory, size);
+#endif
+    }
+}
+#endif
+
+JitExpression::JitExpression(CompiledExpression compiled) :
+    compiled(std::move(compiled))
+{
+#ifdef JIT_X64
+    auto code = Generate(this->compiled);
+
+    // If the OS refuses us executable memory we quietly stay on the interpreter
+    memory = AllocateExecutable(code);
+
+    if (memory)
+    {
+        size = code.size();
+        function = reinterpret_cast<Function>(memory);
+    }
+#endif
+}
+
+JitExpression::~JitExpression()
+{
+#ifdef JIT_X64
+    if (memory)
+        FreeExecutable(memory, size);
+#endif
+}
+
+bool JitExpression::Supported()
+{
+#ifdef JIT_X64
+    return true;
+#else
+    return false;
+#endif
+}
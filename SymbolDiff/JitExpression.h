@@ -0,0 +1,32 @@
+#pragma once
+#include "CompiledExpression.h"
+
+// Native x86-64 machine code generated from a compiled expression. The generated function
+// takes the variable slot array (in compiled.Variables() order) and returns the result.
+// On platforms without a code generator, calls fall back to the bytecode interpreter.
+
+class JitExpression
+{
+public:
+	using Function = double (*)(const double* slots);
+
+	explicit JitExpression(CompiledExpression compiled);
+	~JitExpression();
+
+	JitExpression(const JitExpression&) = delete;
+	JitExpression& operator=(const JitExpression&) = delete;
+
+	double operator()(const double* slots) const { return function ? function(slots) : compiled.Evaluate(slots); }
+
+	// The native function, or nullptr if the expression is being interpreted
+	Function GetFunction() const { return function; }
+	const CompiledExpression& GetCompiled() const { return compiled; }
+
+	static bool Supported();
+
+private:
+	CompiledExpression compiled;
+	Function function = nullptr;
+	void* memory = nullptr;
+	size_t size = 0;
+};
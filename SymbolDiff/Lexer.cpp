@@ -1,91 +1,78 @@
 #include "Lexer.h"
 #include <variant>
 #include <assert.h>
+#include <charconv>
 #include <stdexcept>
 
-std::vector<std::string> SplitInputToTokenStrings(std::string input)
+namespace
 {
-	std::vector<std::string> tokens;
-
-	size_t index = 0;
-	
-	while (index < input.size())
+	enum class CharClass : unsigned char
 	{
-		std::string token;
+		Invalid,
+		Space,
+		Digit,
+		Letter,
+		Operator,
+	};
 
-		if (isspace(input[index]))
-		{
-			// Do nothing
-		}
+	// Every character is classified once, by table lookup
+	struct CharClassTable
+	{
+		CharClass classes[256] = {};
 
-		else if (isdigit(input[index]))
+		CharClassTable()
 		{
-			// Read the whole number, then continue to the next token
-			while (index < input.size() && (isdigit(input[index]) || input[index] == '.'))
+			for (int c = 0; c < 256; c++)
 			{
-				token.push_back(input[index]);
-				index++;
+				if (isspace(c))
+					classes[c] = CharClass::Space;
+				else if (isdigit(c))
+					classes[c] = CharClass::Digit;
+				else if (isalpha(c))
+					classes[c] = CharClass::Letter;
 			}
 
-			tokens.push_back(token);
-			continue;
+			for (char op : { '+', '-', '*', '/', '^', '(', ')' })
+				classes[static_cast<unsigned char>(op)] = CharClass::Operator;
 		}
 
-		else
-		{
-			tokens.push_back({ input[index] });
-		}
-
-		index++;
-	}
-
-	return tokens;
-}
+		CharClass operator[](char c) const { return classes[static_cast<unsigned char>(c)]; }
+	};
 
-// We assume that all numbers are non zero, as '-33' would be lexed as a unary minus '-' and a constant '33'.
+	const CharClassTable charClasses;
 
-std::vector<Token> ConvertStringsToTokens(const std::vector<std::string>& input)
-{
-	std::vector<Token> tokens;
+	// c = constant
+	// v = variable
+	// op = operator but not whichever braket follows
+	// (, ) = respective open or close bracket
 
-	// https://stackoverflow.com/a/29169409
-	auto is_number = [](const std::string& s)
-	{
-		char* end = nullptr;
-		double val = strtod(s.c_str(), &end);
-		return end != s.c_str() && *end == '\0' && val != HUGE_VAL;
-	};
+	//             right
+	//          c  v  op (
+	//         ____________
+	//   l  c | .  x  .  x
+	//   e  v | x  x  .  x
+	//   f op | .  .  .  .
+	//   t  ) | x  x  .  x
+	// 
 
-	auto is_operator = [](const std::string& s)
+	bool EndsTerm(const Token& token)
 	{
-		assert(s.length() >= 1);
-
-		static const std::vector<char> operators = { '+', '-', '*', '/', '^', '(', ')' };
-		return std::find(operators.begin(), operators.end(), s[0]) != operators.end();
-	};
+		return !token.IsOperator() || token.GetOperator() == ')';
+	}
 
-	auto is_variable = [](const std::string& s)
+	bool StartsTerm(const Token& token)
 	{
-		assert(s.length() >= 1);
-
-		return isalpha(s[0]);
-	};
+		return !token.IsOperator() || token.GetOperator() == '(';
+	}
 
-	for (const auto& str : input)
+	void Emit(std::vector<Token>& tokens, Token token)
 	{
-		assert(str.length() > 0);
-
-		if (is_number(str))
-			tokens.push_back(Token::CreateConstant(std::stod(str)));
-		else if (is_operator(str))
-			tokens.push_back(Token::CreateOperator(str[0]));
-		else if (is_variable(str))
-			tokens.push_back(Token::CreateVariable(str[0]));
-		else
-			throw std::invalid_argument("Unknown token: " + str);
-	}			
+		if (!tokens.empty() && EndsTerm(tokens.back()) && StartsTerm(token) &&
+			!(tokens.back().IsConstant() && token.IsConstant()))
+			tokens.push_back(Token::CreateOperator('*'));
 
-	return tokens;
+		tokens.push_back(token);
+	}
 }
 
 bool Token::IsConstant() const
@@ -140,35 +127,55 @@ char Token::GetOperator() const
 	return std::get<static_cast<size_t>(Type::Operator)>(data);
 }
 
-void AddImplicitMultiplication(std::vector<Token>& tokens)
+std::vector<Token> Tokenize(std::string_view input)
 {
-	// c = constant
-	// v = variable
-	// op = operator but not whichever braket follows
-	// (, ) = respective open or close bracket
+	// A single pass over the input, implicit multiplications are inserted as tokens are emitted
 
-	//             right
-	//          c  v  op (
-	//         ____________
-	//   l  c | .  x  .  x
-	//   e  v | x  x  .  x
-	//   f op | .  .  .  .
-	//   t  ) | x  x  .  x
-	// 
+	// We assume that all numbers are non zero, as '-33' would be lexed as a unary minus '-' and a constant '33'.
 
-	for (size_t i = 0; i + 1 < tokens.size(); i++)
-		if ((!tokens[i].IsOperator() || tokens[i].GetOperator() == ')') &&
-			(!tokens[i+1].IsOperator() || tokens[i+1].GetOperator() == '(') && 
-			!(tokens[i].IsConstant() && tokens[i + 1].IsConstant()))
-			tokens.insert(tokens.begin() + i + 1, Token::CreateOperator('*'));
-}
+	std::vector<Token> tokens;
+	tokens.reserve(input.size());
 
-std::vector<Token> Tokenize(const std::string& input)
-{
-	auto tmp1 = SplitInputToTokenStrings(input);
-	auto tmp2 = ConvertStringsToTokens(tmp1);
+	const char* const end = input.data() + input.size();
+	const char* pos = input.data();
+
+	while (pos != end)
+	{
+		switch (charClasses[*pos])
+		{
+		case CharClass::Space:
+			pos++;
+			break;
+
+		case CharClass::Digit:
+		{
+			// The whole run of digits and points must be one number, so e.g '1.2.3' is rejected
+			auto start = pos;
+			while (pos != end && (charClasses[*pos] == CharClass::Digit || *pos == '.'))
+				pos++;
+
+			double value;
+			auto result = std::from_chars(start, pos, value);
 
-	AddImplicitMultiplication(tmp2);
+			if (result.ec != std::errc() || result.ptr != pos)
+				throw std::invalid_argument("Unknown token: " + std::string(start, pos));
 
-	return tmp2;
+			Emit(tokens, Token::CreateConstant(value));
+			break;
+		}
+
+		case CharClass::Letter:
+			Emit(tokens, Token::CreateVariable(*pos++));
+			break;
+
+		case CharClass::Operator:
+			Emit(tokens, Token::CreateOperator(*pos++));
+			break;
+
+		default:
+			throw std::invalid_argument("Unknown token: " + std::string(1, *pos));
+		}
+	}
+
+	return tokens;
 }
@@ -2,6 +2,7 @@
 #include <variant>
 #include <vector>
 #include <string>
+#include <string_view>
 
 class Token
 {
@@ -36,4 +37,4 @@ private:
 	explicit Token(decltype(data)&& value) : data(std::move(value)) {}
 };
 
-std::vector<Token> Tokenize(const std::string& input);
\ No newline at end of file
+std::vector<Token> Tokenize(std::string_view input);
\ No newline at end of file
@@ -1,237 +1,148 @@
 #include "Parser.h"
-#include <stack>
-#include <unordered_map>
 #include <assert.h>
-#include <vector>
-#include <numeric>
 #include <stdexcept>
-#include <algorithm>
-#include <iterator>
 
-void ParseOpenParenthesis(bool& nextIsUnary, std::stack<std::string>& operators);
-void ParseVariable(bool& nextIsUnary, const std::vector<Token>::iterator& token, std::stack<std::unique_ptr<ExpressionBase>>& expressions);
-void ParseConstant(bool& nextIsUnary, const std::vector<Token>::iterator& token, std::stack<std::unique_ptr<ExpressionBase>>& expressions);
-void ParseOperator(bool& nextIsUnary, const std::vector<Token>::iterator& token, std::stack<std::string>& operators, std::stack<std::unique_ptr<ExpressionBase>>& expressions);
-void ParseCloseParenthesis(bool& nextIsUnary, std::stack<std::string>& operators, std::stack<std::unique_ptr<ExpressionBase>>& expressions, bool lastToken);
-
-std::unique_ptr<ExpressionBase> BuildBinaryExpression(std::stack<std::string>& operators, std::stack<std::unique_ptr<ExpressionBase>>& expressions);
-std::unique_ptr<ExpressionBase> BuildUnaryExpression(std::stack<std::string>& operators, std::stack<std::unique_ptr<ExpressionBase>>& expressions);
-
-
-std::unique_ptr<ExpressionBase> BuildExpression(std::vector<Token> input)
+namespace
 {
-    // Reference: CS3901 - Introduction to Data Structures How to Parse Arithmetic Expressions
-
-    if (input.empty()) throw std::invalid_argument("Input cannot be empty");
+    // Precedence climbing over the token array. Operators are handled as their char codes, with
+    // binding power from a switch, so no strings are built and nothing is looked up in a map.
 
-    input.insert(input.begin(), Token::CreateOperator('('));
-    input.emplace_back(Token::CreateOperator(')'));
+    // Unary minus binds tighter than * and /, but looser than ^: -x^2 is -(x^2)
+    constexpr int unaryMinusPrecedence = 3;
 
-    std::stack<std::string> operators;
-    std::stack<std::unique_ptr<ExpressionBase>> expressions;
-
-    bool nextIsUnary = true;
-
-    for (auto token = input.begin(); token != input.end(); ++token)
+    // -1 if the character isn't a binary operator
+    int BinaryPrecedence(char op)
     {
-        // Open parenthesis
-        if (token->IsOperator() && token->GetOperator() == '(')
+        switch (op)
         {
-            ParseOpenParenthesis(nextIsUnary, operators);
+        case '+': case '-': return 1;
+        case '*': case '/': return 2;
+        case '^': return 4;
+        default: return -1;
         }
+    }
 
-        // Close parenthesis
-        else if (token->IsOperator() && token->GetOperator() == ')')
-        {
-            ParseCloseParenthesis(nextIsUnary, operators, expressions, std::next(token) == input.end());
-        }
+    bool IsRightAssociative(char op)
+    {
+        return op == '^';
+    }
 
-        // Other Operator
-        else if (token->IsOperator())
+    std::unique_ptr<ExpressionBase> MakeBinary(char op, std::unique_ptr<ExpressionBase>&& lhs, std::unique_ptr<ExpressionBase>&& rhs)
+    {
+        switch (op)
         {
-            ParseOperator(nextIsUnary, token, operators, expressions);
+        case '+': return std::make_unique<OperatorPlus>(std::move(lhs), std::move(rhs));
+        case '-': return std::make_unique<OperatorMinus>(std::move(lhs), std::move(rhs));
+        case '*': return std::make_unique<OperatorMultiply>(std::move(lhs), std::move(rhs));
+        case '/': return std::make_unique<OperatorDivide>(std::move(lhs), std::move(rhs));
+        case '^': return std::make_unique<OperatorExponent>(std::move(lhs), std::move(rhs));
         }
 
-        // Number
-        else if (token->IsConstant())
-        {
-            ParseConstant(nextIsUnary, token, expressions);
-        }
+        throw std::invalid_argument("Invalid expression: could not build binary expression with operator '" + std::string{ op } + "'");
+    }
 
-        // Variable
-        else if (token->IsVariable())
+    class Parser
+    {
+    public:
+        explicit Parser(const std::vector<Token>& input) :
+            token(input.data()), end(input.data() + input.size())
         {
-            ParseVariable(nextIsUnary, token, expressions);
         }
 
-        else
+        std::unique_ptr<ExpressionBase> Parse()
         {
-            // This should never happen
-            assert(!"You have made a new type of token without editing the parsing code");
+            auto expr = ParseExpression(0);
+
+            // Only an unmatched ')' stops the outermost level early
+            if (token != end)
+                throw std::invalid_argument("Invalid expression: unbalanced parenthesis");
+
+            return expr;
         }
-    }
 
-    if (!operators.empty() || expressions.size() != 1) 
-        throw std::invalid_argument("Invalid expression: unbalanced parenthesis");
+    private:
+        // Parses a term followed by any binary operators binding at least as tightly as minPrecedence
+        std::unique_ptr<ExpressionBase> ParseExpression(int minPrecedence)
+        {
+            auto lhs = ParseOperand();
 
-    return std::move(expressions.top());
-}
+            while (token != end)
+            {
+                if (token->IsVariable())
+                    throw std::invalid_argument("Invalid expression: variable ('" + std::string{ token->GetVariable() } + "') directly after term");
 
-void ParseCloseParenthesis(bool& nextIsUnary, std::stack<std::string>& operators, std::stack<std::unique_ptr<ExpressionBase>>& expressions, bool lastToken)
-{
-    if (nextIsUnary)
-        throw std::invalid_argument("Invalid expression: '()' is invalid");
+                if (token->IsConstant())
+                    throw std::invalid_argument("Invalid expression: constant ('" + std::to_string(token->GetConstant()) + "') directly after term");
 
-    while (operators.top() != "(")
-    {
-        if (operators.top() == "unary")
-        {
-            expressions.emplace(BuildUnaryExpression(operators, expressions));
-        }
-        else
-        {
-            expressions.emplace(BuildBinaryExpression(operators, expressions));
-        }
-    }
+                auto op = token->GetOperator();
 
-    operators.pop();
+                if (op == '(')
+                    throw std::invalid_argument("Invalid expression: '(' directly after term");
 
-    if (operators.empty() && !lastToken)
-    {
-        throw std::invalid_argument("Invalid expression: unbalanced parenthesis");
-    }
+                auto precedence = BinaryPrecedence(op);
 
-    nextIsUnary = false;
-}
+                // ')' has no precedence, so also ends the loop
+                if (precedence < minPrecedence)
+                    break;
 
-void ParseOperator(bool& nextIsUnary, const std::vector<Token>::iterator& token, std::stack<std::string>& operators, std::stack<std::unique_ptr<ExpressionBase>>& expressions)
-{
-    static const std::unordered_map<std::string, int> prio =
-    {
-        { "^", 5 },         // 'current' exponent
-        { "exponent", 4 },  // 'old' exponent which is further left
-        { "unary", 3 },
-        { "*", 2 },
-        { "/", 2 },
-        { "+", 1 },
-        { "-", 1 },
-        { "(", 0 },
-    };
+                token++;
 
-    if (nextIsUnary)
-    {
-        if (token->GetOperator() == '-')
-        {
-            operators.emplace(std::string{ token->GetOperator() });
-            operators.emplace("unary");
-        }
-        else
-        {
-            throw std::invalid_argument("Invalid expression: only '-' can be unary, not '" + std::string{ token->GetOperator() } + "')");
-        }
-    }
-    else
-    {
-        while (prio.at(operators.top()) >= prio.at({ token->GetOperator() }))
-        {
-            if (operators.top() == "unary")
-            {
-                expressions.emplace(BuildUnaryExpression(operators, expressions));
+                auto rhs = ParseExpression(IsRightAssociative(op) ? precedence : precedence + 1);
+                lhs = MakeBinary(op, std::move(lhs), std::move(rhs));
             }
-            else
-            {
-                expressions.emplace(BuildBinaryExpression(operators, expressions));
-            }
-        }
 
-        if (token->GetOperator() == '^')
-        {
-            operators.emplace("exponent");
+            return lhs;
         }
-        else
-        {
-            operators.emplace(std::string{ token->GetOperator() });
-        }
-    }
-
-    nextIsUnary = true;
-}
 
-void ParseVariable(bool& nextIsUnary, const std::vector<Token>::iterator& token, std::stack<std::unique_ptr<ExpressionBase>>& expressions)
-{
-    if (!nextIsUnary)
-        throw std::invalid_argument("Invalid expression: variable ('" + std::string{ token->GetVariable() } + "') directly after term");
+        std::unique_ptr<ExpressionBase> ParseOperand()
+        {
+            if (token == end)
+                throw std::invalid_argument("Invalid expression: expected an operand at the end of the input");
 
-    expressions.push(std::make_unique<Variable>(token->GetVariable()));
+            const auto& current = *token++;
 
-    nextIsUnary = false;
-}
+            if (current.IsConstant())
+                return std::make_unique<Constant>(current.GetConstant());
 
-void ParseConstant(bool& nextIsUnary, const std::vector<Token>::iterator& token, std::stack<std::unique_ptr<ExpressionBase>>& expressions)
-{
-    if (!nextIsUnary)
-        throw std::invalid_argument("Invalid expression: constant ('" + std::to_string(token->GetConstant()) + "') directly after term");
+            if (current.IsVariable())
+                return std::make_unique<Variable>(current.GetVariable());
 
-    expressions.push(std::make_unique<Constant>(token->GetConstant()));
+            assert(current.IsOperator());
 
-    nextIsUnary = false;
-}
-
-std::unique_ptr<ExpressionBase> BuildBinaryExpression(std::stack<std::string>& operators, std::stack<std::unique_ptr<ExpressionBase>>& expressions)
-{
-    if (operators.size() < 1) throw std::invalid_argument("Invalid expression: trying to build binary expression with empty operator stack");
-    if (expressions.size() < 2) throw std::invalid_argument("Invalid expression: binary expression '" + operators.top() + "' without two operands");
-
-    auto op = operators.top();
-    operators.pop();
-
-    auto rhs = std::move(expressions.top());
-    expressions.pop();
-
-    auto lhs = std::move(expressions.top());
-    expressions.pop();
-
-    if (op == "+")
-        return std::make_unique<OperatorPlus>(std::move(lhs), std::move(rhs));
-    if (op == "-")
-        return std::make_unique<OperatorMinus>(std::move(lhs), std::move(rhs));
-    if (op == "/")
-        return std::make_unique<OperatorDivide>(std::move(lhs), std::move(rhs));
-    if (op == "*")
-        return std::make_unique<OperatorMultiply>(std::move(lhs), std::move(rhs));
-    if (op == "exponent")
-        return std::make_unique<OperatorExponent>(std::move(lhs), std::move(rhs));
-
-    throw std::invalid_argument("Invalid expression: could not build binary expression with operator '" + op + "'");
-}
+            switch (current.GetOperator())
+            {
+            case '-':
+                return std::make_unique<OperatorUnaryMinus>(ParseExpression(unaryMinusPrecedence));
 
-std::unique_ptr<ExpressionBase> BuildUnaryExpression(std::stack<std::string>& operators, std::stack<std::unique_ptr<ExpressionBase>>& expressions)
-{
-    if (operators.size() < 2) throw std::invalid_argument("Invalid expression: trying to build unary expression with empty operator stack");
+            case '(':
+            {
+                auto expr = ParseExpression(0);
 
-    operators.pop();    // "unary"
+                if (token == end)
+                    throw std::invalid_argument("Invalid expression: unbalanced parenthesis");
 
-    if (expressions.size() < 1) throw std::invalid_argument("Invalid expression: unary expression '" + operators.top() + "' without operand");
+                assert(token->IsOperator() && token->GetOperator() == ')');
+                token++;
 
-    auto op = operators.top();
-    operators.pop();
+                return expr;
+            }
 
-    auto rhs = std::move(expressions.top());
-    expressions.pop();
+            case ')':
+                throw std::invalid_argument("Invalid expression: '()' is invalid");
 
-    if (op == "-")
-        return std::make_unique<OperatorUnaryMinus>(std::move(rhs));
+            default:
+                throw std::invalid_argument("Invalid expression: only '-' can be unary, not '" + std::string{ current.GetOperator() } + "'");
+            }
+        }
 
-    throw std::invalid_argument("Invalid expression: could not build unary expression with operator '" + op + "'");
+        const Token* token;
+        const Token* const end;
+    };
 }
 
-void ParseOpenParenthesis(bool& nextIsUnary, std::stack<std::string>& operators)
+std::unique_ptr<ExpressionBase> BuildExpression(const std::vector<Token>& input)
 {
-    if (!nextIsUnary)
-        throw std::invalid_argument("Invalid expression: '(' directly after term");
-
-    operators.emplace("(");
+    if (input.empty()) throw std::invalid_argument("Input cannot be empty");
 
-    nextIsUnary = true;
+    return Parser(input).Parse();
 }
-
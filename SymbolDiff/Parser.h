@@ -2,4 +2,4 @@
 #include "Lexer.h"
 #include "Expression.h"
 
-std::unique_ptr<ExpressionBase> BuildExpression(std::vector<Token> input);
\ No newline at end of file
+std::unique_ptr<ExpressionBase> BuildExpression(const std::vector<Token>& input);
\ No newline at end of file
@@ -0,0 +1,268 @@
+#include "Polynomial.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+std::optional<Polynomial> Polynomial::FromExpression(const ExpressionBase& expr)
+{
+    Polynomial polynomial;
+
+    auto set = expr.GetSetOfAllSubVariables();
+    polynomial.variables.assign(set.begin(), set.end());
+    std::sort(polynomial.variables.begin(), polynomial.variables.end());
+
+    if (!polynomial.AddTerms(expr, 1))
+        return std::nullopt;
+
+    polynomial.Collect();
+    return polynomial;
+}
+
+bool Polynomial::AddTerms(const ExpressionBase& expr, double sign)
+{
+    if (auto plus = ExpressionCast<OperatorPlus>(&expr))
+        return AddTerms(plus->GetLeft(), sign) && AddTerms(plus->GetRight(), sign);
+
+    if (auto minus = ExpressionCast<OperatorMinus>(&expr))
+        return AddTerms(minus->GetLeft(), sign) && AddTerms(minus->GetRight(), -sign);
+
+    if (auto unaryMinus = ExpressionCast<OperatorUnaryMinus>(&expr))
+        return AddTerms(unaryMinus->GetRight(), -sign);
+
+    // A division is only read at the top of a monomial, where its derivative divides once.
+    // Anywhere else the engine's derivative would round more than once, so it's left to the engine.
+    const ExpressionBase* monomial = &expr;
+    double divisor = 1;
+
+    if (auto divide = ExpressionCast<OperatorDivide>(&expr))
+    {
+        auto constant = ExpressionCast<Constant>(&divide->GetRight());
+        if (!constant || constant->GetConstant() == 0) return false;
+
+        monomial = &divide->GetLeft();
+        divisor = constant->GetConstant();
+    }
+
+    // Written in place, so the term is complete once its monomial has been read
+    double coefficient = sign;
+    auto offset = exponents.size();
+    exponents.resize(offset + variables.size(), 0);
+
+    if (!MultiplyMonomial(*monomial, coefficient, exponents.data() + offset))
+        return false;
+
+    coefficients.push_back(coefficient);
+    divisors.push_back(divisor);
+    return true;
+}
+
+bool Polynomial::MultiplyMonomial(const ExpressionBase& expr, double& coefficient, uint32_t* powers) const
+{
+    // Constants are multiplied in left to right, the same order the RewriteEngine does
+    if (auto constant = ExpressionCast<Constant>(&expr))
+    {
+        coefficient *= constant->GetConstant();
+        return true;
+    }
+
+    if (auto variable = ExpressionCast<Variable>(&expr))
+        return ++powers[IndexOf(variable->GetVariable())] != 0;
+
+    if (auto multiply = ExpressionCast<OperatorMultiply>(&expr))
+        return MultiplyMonomial(multiply->GetLeft(), coefficient, powers) && MultiplyMonomial(multiply->GetRight(), coefficient, powers);
+
+    if (auto unaryMinus = ExpressionCast<OperatorUnaryMinus>(&expr))
+    {
+        coefficient = -coefficient;
+        return MultiplyMonomial(unaryMinus->GetRight(), coefficient, powers);
+    }
+
+    if (auto exponent = ExpressionCast<OperatorExponent>(&expr))
+    {
+        auto variable = ExpressionCast<Variable>(&exponent->GetLeft());
+        auto power = ExpressionCast<Constant>(&exponent->GetRight());
+        if (!variable || !power) return false;
+
+        auto value = power->GetConstant();
+        auto& slot = powers[IndexOf(variable->GetVariable())];
+
+        if (!(value >= 0 && value <= UINT32_MAX - slot && std::trunc(value) == value)) return false;
+
+        slot += static_cast<uint32_t>(value);
+        return true;
+    }
+
+    return false;
+}
+
+size_t Polynomial::IndexOf(char variable) const
+{
+    return std::lower_bound(variables.begin(), variables.end(), variable) - variables.begin();
+}
+
+int Polynomial::Compare(size_t lhs, size_t rhs) const
+{
+    // The same order as RewriteEngine gives the terms of a sum: walking the variables of each
+    // term in turn, the first variable comes first, then the higher power, and a term that runs
+    // out of variables comes last
+    auto l = ExponentsOf(lhs);
+    auto r = ExponentsOf(rhs);
+    size_t i = 0, j = 0;
+    const auto count = variables.size();
+
+    for (;;)
+    {
+        while (i < count && l[i] == 0) i++;
+        while (j < count && r[j] == 0) j++;
+
+        if (i == count || j == count)
+            return i == j ? 0 : i == count ? 1 : -1;
+
+        if (i != j)
+            return i < j ? -1 : 1;
+
+        if (l[i] != r[j])
+            return l[i] > r[j] ? -1 : 1;
+
+        i++;
+        j++;
+    }
+}
+
+void Polynomial::Collect()
+{
+    const auto count = variables.size();
+
+    std::vector<size_t> order(coefficients.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [this](size_t lhs, size_t rhs) { return Compare(lhs, rhs) < 0; });
+
+    std::vector<double> sortedCoefficients;
+    std::vector<double> sortedDivisors;
+    std::vector<uint32_t> sortedExponents;
+    sortedCoefficients.reserve(order.size());
+    sortedDivisors.reserve(order.size());
+    sortedExponents.reserve(exponents.size());
+
+    for (size_t k = 0; k < order.size(); k++)
+    {
+        if (k > 0 && Compare(order[k - 1], order[k]) == 0 && sortedDivisors.back() == 1 && divisors[order[k]] == 1)
+        {
+            sortedCoefficients.back() += coefficients[order[k]];
+            continue;
+        }
+
+        sortedCoefficients.push_back(coefficients[order[k]]);
+        sortedDivisors.push_back(divisors[order[k]]);
+        sortedExponents.insert(sortedExponents.end(), ExponentsOf(order[k]), ExponentsOf(order[k]) + count);
+    }
+
+    coefficients.clear();
+    divisors.clear();
+    exponents.clear();
+
+    for (size_t k = 0; k < sortedCoefficients.size(); k++)
+    {
+        if (sortedCoefficients[k] == 0) continue;
+
+        coefficients.push_back(sortedCoefficients[k]);
+        divisors.push_back(sortedDivisors[k]);
+        exponents.insert(exponents.end(), sortedExponents.begin() + k * count, sortedExponents.begin() + (k + 1) * count);
+    }
+}
+
+void Polynomial::Divide()
+{
+    for (size_t term = 0; term < Terms(); term++)
+    {
+        coefficients[term] /= divisors[term];
+        divisors[term] = 1;
+    }
+}
+
+Polynomial Polynomial::Derivative(char wrt) const
+{
+    Polynomial derivative;
+    derivative.variables = variables;
+
+    auto index = IndexOf(wrt);
+    if (index == variables.size() || variables[index] != wrt)
+        return derivative;
+
+    for (size_t term = 0; term < Terms(); term++)
+    {
+        auto power = ExponentsOf(term)[index];
+        if (power == 0) continue;
+
+        derivative.coefficients.push_back(coefficients[term] * power / divisors[term]);
+        derivative.divisors.push_back(1);
+        derivative.exponents.insert(derivative.exponents.end(), ExponentsOf(term), ExponentsOf(term) + variables.size());
+        derivative.exponents[derivative.exponents.size() - variables.size() + index]--;
+    }
+
+    // Lowering one power never makes two distinct terms alike, and almost always keeps them in
+    // order, so unless there are like terms left to merge this is usually just the linear check
+    for (size_t term = 1; term < derivative.Terms(); term++)
+    {
+        if (derivative.Compare(term - 1, term) >= 0)
+        {
+            derivative.Collect();
+            break;
+        }
+    }
+
+    return derivative;
+}
+
+std::string Polynomial::Print() const
+{
+    if (std::any_of(divisors.begin(), divisors.end(), [](double divisor) { return divisor != 1; }))
+    {
+        auto divided = *this;
+        divided.Divide();
+        divided.Collect();
+        return divided.Print();
+    }
+
+    if (coefficients.empty())
+        return "0";
+
+    // Matches how the RewriteEngine builds a sum of terms and how its nodes print
+    std::string str;
+
+    for (size_t term = 0; term < Terms(); term++)
+    {
+        auto coefficient = coefficients[term];
+        auto powers = ExponentsOf(term);
+        bool hasVariables = std::any_of(powers, powers + variables.size(), [](uint32_t power) { return power != 0; });
+
+        if (term > 0)
+        {
+            str += coefficient < 0 ? "-" : "+";
+            coefficient = std::abs(coefficient);
+        }
+
+        if (!hasVariables)
+            Constant::Format(coefficient, str);
+        else if (coefficient == -1)
+            str += "-";
+        else if (coefficient != 1)
+            Constant::Format(coefficient, str);
+
+        for (size_t i = 0; i < variables.size(); i++)
+        {
+            if (powers[i] == 0) continue;
+
+            str += variables[i];
+
+            if (powers[i] != 1)
+            {
+                str += '^';
+                Constant::Format(powers[i], str);
+            }
+        }
+    }
+
+    return str;
+}
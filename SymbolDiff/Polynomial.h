@@ -0,0 +1,52 @@
+#pragma once
+#include "Expression.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Sparse multivariate polynomial, a list of terms each holding a coefficient and the exponent
+// of every variable. Terms are kept in the same canonical order the RewriteEngine sorts sums
+// into, so differentiating and printing a polynomial gives the same text as the general
+// pipeline, in time linear in the number of terms.
+
+class Polynomial
+{
+public:
+	// Returns nullopt unless expr is a sum of monomials, which are products of constants and
+	// whole non-negative powers of variables, each optionally divided by one nonzero constant
+	static std::optional<Polynomial> FromExpression(const ExpressionBase& expr);
+
+	Polynomial Derivative(char wrt) const;
+	std::string Print() const;
+
+	size_t Terms() const { return coefficients.size(); }
+	const std::vector<char>& Variables() const { return variables; }
+
+private:
+	Polynomial() = default;
+
+	const uint32_t* ExponentsOf(size_t term) const { return exponents.data() + term * variables.size(); }
+	size_t IndexOf(char variable) const;
+
+	// Both return false if the expression isn't of the form FromExpression accepts
+	bool AddTerms(const ExpressionBase& expr, double sign);
+	bool MultiplyMonomial(const ExpressionBase& expr, double& coefficient, uint32_t* powers) const;
+
+	// Orders like terms together, 0 if they are alike
+	int Compare(size_t lhs, size_t rhs) const;
+	// Sorts the terms, merging like terms and dropping those that cancel. Terms with a divisor
+	// are only merged once divided through, see divisors.
+	void Collect();
+	// Divides every coefficient through by its divisor
+	void Divide();
+
+	std::vector<char> variables;		// Sorted
+	std::vector<double> coefficients;
+	// The RewriteEngine differentiates m/d by the quotient rule, (d*m'-m*0)/d^2, and folds the
+	// constants of the numerator before dividing, so differentiating a term multiplies its
+	// coefficient by the power before dividing by its divisor, rounding once as the engine does.
+	// Like terms are summed only after dividing, in order, again as the engine does.
+	std::vector<double> divisors;
+	std::vector<uint32_t> exponents;	// variables.size() per term
+};
@@ -0,0 +1,126 @@
+#include "RandomExpression.h"
+
+#include <random>
+#include <stdexcept>
+
+namespace
+{
+    constexpr char variableNames[] = "xyzabcdefghijklmnopqrstuvw";
+
+    enum Operator { Plus, Minus, Multiply, Divide, Exponent, UnaryMinus };
+
+    class Generator
+    {
+    public:
+        explicit Generator(const RandomExpressionOptions& options) :
+            options(options),
+            eng(options.seed),
+            weights{ options.plus, options.minus, options.multiply, options.divide, options.exponent, options.unaryMinus }
+        {
+        }
+
+        std::unique_ptr<ExpressionBase> Build(size_t size, size_t depth)
+        {
+            // Two nodes only fit a unary minus over a leaf
+            if (size <= 1 || depth >= options.maxDepth || (size == 2 && weights[UnaryMinus] <= 0))
+                return Leaf();
+
+            auto op = size == 2 ? UnaryMinus : PickOperator();
+
+            if (op == UnaryMinus)
+                return std::make_unique<OperatorUnaryMinus>(Build(size - 1, depth + 1));
+
+            // Draws are made in separate statements, as the order arguments are evaluated in varies
+            if (op == Exponent)
+            {
+                auto exponent = std::make_unique<Constant>(2 + static_cast<double>(Below(2)));
+                return std::make_unique<OperatorExponent>(Build(size - 2, depth + 1), std::move(exponent));
+            }
+
+            // Uneven splits give both deep chains and bushy subtrees
+            auto left = 1 + Below(size - 2);
+            auto l = Build(left, depth + 1);
+            auto r = Build(size - 1 - left, depth + 1);
+
+            switch (op)
+            {
+            case Plus: return std::make_unique<OperatorPlus>(std::move(l), std::move(r));
+            case Minus: return std::make_unique<OperatorMinus>(std::move(l), std::move(r));
+            case Multiply: return std::make_unique<OperatorMultiply>(std::move(l), std::move(r));
+            default: return std::make_unique<OperatorDivide>(std::move(l), std::move(r));
+            }
+        }
+
+    private:
+        std::unique_ptr<ExpressionBase> Leaf()
+        {
+            if (options.variables == 0 || Uniform() < options.constants)
+                return std::make_unique<Constant>(1 + static_cast<double>(Below(9)));
+
+            return std::make_unique<Variable>(RandomVariable(Below(options.variables)));
+        }
+
+        Operator PickOperator()
+        {
+            double total = 0;
+
+            for (auto weight : weights)
+                total += weight;
+
+            auto pick = Uniform() * total;
+            auto picked = UnaryMinus;
+
+            // Rounding may leave pick past the last bucket, which then takes it
+            for (size_t op = 0; op <= UnaryMinus; op++)
+            {
+                if (weights[op] <= 0) continue;
+
+                picked = static_cast<Operator>(op);
+
+                if (pick < weights[op]) break;
+
+                pick -= weights[op];
+            }
+
+            return picked;
+        }
+
+        // The draws are made from the engine's output directly, as unlike the engine the standard
+        // distributions may give different numbers with different standard libraries
+
+        // In [0, 1)
+        double Uniform()
+        {
+            return eng() / 4294967296.0;
+        }
+
+        // In [0, n), 32 random bits leave a negligible bias for any n that fits in memory
+        size_t Below(size_t n)
+        {
+            return static_cast<size_t>(Uniform() * n);
+        }
+
+        const RandomExpressionOptions& options;
+        std::mt19937 eng;
+        double weights[UnaryMinus + 1];
+    };
+}
+
+char RandomVariable(size_t n)
+{
+    if (n >= sizeof(variableNames) - 1)
+        throw std::invalid_argument("RandomExpression draws from at most 26 variables");
+
+    return variableNames[n];
+}
+
+std::unique_ptr<ExpressionBase> RandomExpression(const RandomExpressionOptions& options)
+{
+    if (options.variables > sizeof(variableNames) - 1)
+        throw std::invalid_argument("RandomExpression draws from at most 26 variables");
+
+    if (options.plus + options.minus + options.multiply + options.divide + options.exponent + options.unaryMinus <= 0)
+        throw std::invalid_argument("RandomExpression needs at least one operator with a positive weight");
+
+    return Generator(options).Build(options.size, 0);
+}
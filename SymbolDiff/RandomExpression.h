@@ -0,0 +1,35 @@
+#pragma once
+#include "Expression.h"
+
+#include <memory>
+
+// Random expressions for stress tests and differential tests, built directly as trees so even
+// millions of nodes take no parsing. The same options, seed included, always give the same
+// expression on any platform. Exponents are always whole constants, so every generated
+// expression is defined wherever its divisors are nonzero, and its derivative by the power
+// rule is exact.
+
+struct RandomExpressionOptions
+{
+	unsigned seed = 0;
+	// Nodes in the tree, exactly unless maxDepth cuts branches short
+	size_t size = 64;
+	size_t maxDepth = 64;
+	// Drawn from x, y, z, a, b, ... in that order
+	size_t variables = 1;
+	// Chance that a leaf is a whole constant from 1 to 9 rather than a variable
+	double constants = 0.3;
+
+	// Relative weights of the operators, 0 leaves one out
+	double plus = 4;
+	double minus = 2;
+	double multiply = 3;
+	double divide = 1;
+	double exponent = 1;		// To the power 2 or 3
+	double unaryMinus = 1;
+};
+
+std::unique_ptr<ExpressionBase> RandomExpression(const RandomExpressionOptions& options = {});
+
+// The nth variable RandomExpression draws from
+char RandomVariable(size_t n);
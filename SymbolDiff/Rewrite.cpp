@@ -0,0 +1,513 @@
+#include "Rewrite.h"
+#include "Instrumentation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+    using Rule = RewriteEngine::Rule;
+    using Kind = ExpressionKind;
+
+    // Rules are tried in order, the first that matches is applied
+    const std::vector<Rule>& RulesFor(Kind kind)
+    {
+        static const std::vector<Rule> sum = { Rule::EvaluateConstant, Rule::CollectTerms };
+        static const std::vector<Rule> product = { Rule::EvaluateConstant, Rule::CollectFactors };
+        static const std::vector<Rule> exponent = { Rule::PowerOfOne, Rule::ExponentOne, Rule::EvaluateConstant, Rule::CollectFactors };
+        static const std::vector<Rule> leaf = {};
+
+        switch (kind)
+        {
+        case Kind::Plus:
+        case Kind::Minus:
+        case Kind::UnaryMinus: return sum;
+        case Kind::Multiply:
+        case Kind::Divide: return product;
+        case Kind::Exponent: return exponent;
+        default: return leaf;
+        }
+    }
+
+    enum class Chain
+    {
+        None,
+        Sum,
+        Product,
+    };
+
+    Chain ChainOf(Kind kind)
+    {
+        switch (kind)
+        {
+        case Kind::Plus:
+        case Kind::Minus:
+        case Kind::UnaryMinus: return Chain::Sum;
+        case Kind::Multiply:
+        case Kind::Divide: return Chain::Product;
+        default: return Chain::None;
+        }
+    }
+
+    // The collected form of a chain is final, nothing else applies to it
+    bool Collects(Rule rule)
+    {
+        return rule == Rule::CollectTerms || rule == Rule::CollectFactors;
+    }
+
+    bool IsConstant(const ExpressionBase* expr)
+    {
+        return expr && expr->Kind() == Kind::Constant;
+    }
+
+    bool IsConstant(const ExpressionBase* expr, double value)
+    {
+        return IsConstant(expr) && static_cast<const Constant*>(expr)->GetConstant() == value;
+    }
+
+    // Sort order of the types of node, so variables come first and constants last
+    int Rank(Kind kind)
+    {
+        switch (kind)
+        {
+        case Kind::Variable: return 0;
+        case Kind::Exponent: return 1;
+        case Kind::Plus: return 2;
+        case Kind::Minus: return 3;
+        case Kind::Multiply: return 4;
+        case Kind::Divide: return 5;
+        case Kind::UnaryMinus: return 6;
+        default: return 7;
+        }
+    }
+
+    template <typename T>
+    int CompareValues(T lhs, T rhs)
+    {
+        return lhs < rhs ? -1 : rhs < lhs ? 1 : 0;
+    }
+}
+
+std::unique_ptr<ExpressionBase> RewriteEngine::Rewrite(std::unique_ptr<ExpressionBase> expr)
+{
+    SYMBOLDIFF_COUNT(simplifyPasses);
+
+    Pass(expr, std::nullopt);
+    return expr;
+}
+
+void RewriteEngine::Pass(std::unique_ptr<ExpressionBase>& node, std::optional<ExpressionKind> parent)
+{
+    // Simplifying forces lazy derivatives, whose expansion may itself start with one
+    while (node->Kind() == Kind::LazyDerivative)
+        node = static_cast<LazyDerivative&>(*node).Expanded().Clone();
+
+    auto operands = OperandsOf(*node);
+
+    if (operands.left)
+        Pass(*operands.left, operands.kind);
+
+    if (operands.right)
+        Pass(*operands.right, operands.kind);
+
+    statistics.visits++;
+
+    // Collecting at the top of a chain rewrites the whole chain, and a sum or product collects
+    // the products and powers that are its terms and factors, so there's no point collecting
+    // those on their own first
+    auto chain = ChainOf(operands.kind);
+    auto parentChain = parent ? ChainOf(*parent) : Chain::None;
+    bool collect;
+
+    if (operands.kind == Kind::Exponent)
+        collect = parentChain == Chain::None;
+    else
+        collect = chain != parentChain && !(chain == Chain::Product && parentChain == Chain::Sum);
+
+    ApplyRules(node, collect);
+}
+
+void RewriteEngine::ApplyRules(std::unique_ptr<ExpressionBase>& node, bool collect)
+{
+    bool applied = true;
+
+    // Keep going until no rule matches, as each rewrite can enable another (or replace the node)
+    while (applied)
+    {
+        applied = false;
+
+        auto operands = OperandsOf(*node);
+
+        for (auto rule : RulesFor(operands.kind))
+        {
+            if (Collects(rule) && !collect) continue;
+
+            if (TryRule(rule, node, operands))
+            {
+                applied = !Collects(rule);
+                break;
+            }
+        }
+    }
+}
+
+bool RewriteEngine::TryRule(Rule rule, std::unique_ptr<ExpressionBase>& node, const Operands& operands)
+{
+    if (statistics.applications >= budget)
+    {
+        statistics.budgetExhausted = true;
+        return false;
+    }
+
+    auto left = operands.left ? operands.left->get() : nullptr;
+    auto right = operands.right ? operands.right->get() : nullptr;
+
+    // Replaces the node with one of its operands, which is moved rather than copied
+    auto replaceWith = [&node](std::unique_ptr<ExpressionBase>* operand)
+    {
+        auto replacement = std::move(*operand);
+        node = std::move(replacement);
+    };
+
+    bool applied = false;
+
+    switch (rule)
+    {
+    case Rule::CollectTerms:
+    case Rule::CollectFactors:
+    {
+        // Powers are only worth collecting if the exponent is constant
+        if (operands.kind == Kind::Exponent && !IsConstant(right)) break;
+
+        // A product is collected as a sum of one term, which lets 2(x+1) expand to 2x+2. The
+        // chain is always rebuilt, but only counts as a rewrite if that changed anything.
+        auto before = node->Hash();
+
+        std::vector<Term> terms;
+        FlattenSum(node, 1, terms);
+        CollectTerms(terms);
+
+        node = BuildSum(terms);
+        applied = node->Hash() != before;
+        break;
+    }
+    case Rule::PowerOfOne:
+        if ((applied = IsConstant(left, 1)))
+            node = std::make_unique<Constant>(1);
+        break;
+    case Rule::ExponentOne:
+        if ((applied = IsConstant(right, 1)))
+            replaceWith(operands.left);
+        break;
+    case Rule::EvaluateConstant:
+        // Operands are simplified first, so a constant subexpression has been folded into a
+        // single constant by the time its parent is visited. Adding 0 turns -(0) into 0 not -0.
+        if ((applied = (!left || IsConstant(left)) && IsConstant(right)))
+            node = std::make_unique<Constant>(*node->Evaluate() + 0.0);
+        break;
+    default:
+        break;
+    }
+
+    if (applied)
+    {
+        statistics.applications++;
+        statistics.applicationsPerRule[static_cast<size_t>(rule)]++;
+    }
+
+    return applied;
+}
+
+void RewriteEngine::FlattenSum(std::unique_ptr<ExpressionBase>& node, double scale, std::vector<Term>& terms)
+{
+    auto operands = OperandsOf(*node);
+
+    switch (operands.kind)
+    {
+    case Kind::Plus:
+        FlattenSum(*operands.left, scale, terms);
+        FlattenSum(*operands.right, scale, terms);
+        return;
+    case Kind::Minus:
+        FlattenSum(*operands.left, scale, terms);
+        FlattenSum(*operands.right, -scale, terms);
+        return;
+    case Kind::UnaryMinus:
+        FlattenSum(*operands.right, -scale, terms);
+        return;
+    default:
+        break;
+    }
+
+    Term term{ scale, {} };
+    FlattenProduct(node, 1, term);
+
+    // A multiple of a sum is distributed: 2(x+1) -> 2x+2
+    if (term.factors.size() == 1 && term.factors[0].exponent == 1 && ChainOf(OperandsOf(*term.factors[0].base).kind) == Chain::Sum)
+        FlattenSum(term.factors[0].base, term.coefficient, terms);
+    else
+        terms.push_back(std::move(term));
+}
+
+void RewriteEngine::FlattenProduct(std::unique_ptr<ExpressionBase>& node, double exponent, Term& term)
+{
+    // The exponent is always whole, as only whole powers are distributed over a product
+    auto operands = OperandsOf(*node);
+
+    switch (operands.kind)
+    {
+    case Kind::Multiply:
+        FlattenProduct(*operands.left, exponent, term);
+        FlattenProduct(*operands.right, exponent, term);
+        return;
+    case Kind::Divide:
+        FlattenProduct(*operands.left, exponent, term);
+        FlattenProduct(*operands.right, -exponent, term);
+        return;
+    case Kind::UnaryMinus:
+        if (std::fmod(exponent, 2) != 0)
+            term.coefficient = -term.coefficient;
+
+        FlattenProduct(*operands.right, exponent, term);
+        return;
+    case Kind::Exponent:
+        if (IsConstant(operands.right->get()))
+        {
+            auto power = static_cast<Constant&>(**operands.right).GetConstant() * exponent;
+
+            // (2x)^2 -> 4x^2, (-x)^3 -> -x^3 and (x^2)^3 -> x^6, but (x^2)^0.5 is |x| not x
+            if (std::trunc(power) == power)
+                FlattenProduct(*operands.left, power, term);
+            else
+                term.factors.push_back(Factor{ std::move(*operands.left), power });
+
+            return;
+        }
+        break;
+    default:
+        if (IsConstant(node.get()))
+        {
+            auto value = static_cast<Constant&>(*node).GetConstant();
+
+            // Division by 0 is left for the expression to show
+            if (value != 0 || exponent > 0)
+            {
+                if (exponent == 1)
+                    term.coefficient *= value;
+                else if (exponent == -1)
+                    term.coefficient /= value;
+                else
+                    term.coefficient *= std::pow(value, exponent);
+
+                return;
+            }
+        }
+        break;
+    }
+
+    term.factors.push_back(Factor{ std::move(node), exponent });
+}
+
+void RewriteEngine::CollectFactors(Term& term)
+{
+    auto& factors = term.factors;
+
+    std::stable_sort(factors.begin(), factors.end(), [](const Factor& lhs, const Factor& rhs) { return Compare(*lhs.base, *rhs.base) < 0; });
+
+    // x^a * x^b -> x^(a+b), dropping x^0
+    size_t count = 0;
+
+    for (auto& factor : factors)
+    {
+        if (count > 0 && Compare(*factors[count - 1].base, *factor.base) == 0)
+            factors[count - 1].exponent += factor.exponent;
+        else if (&factors[count] != &factor)
+            factors[count++] = std::move(factor);
+        else
+            count++;
+    }
+
+    factors.resize(count);
+    factors.erase(std::remove_if(factors.begin(), factors.end(), [](const Factor& factor) { return factor.exponent == 0; }), factors.end());
+}
+
+void RewriteEngine::CollectTerms(std::vector<Term>& terms)
+{
+    for (auto& term : terms)
+        CollectFactors(term);
+
+    std::stable_sort(terms.begin(), terms.end(), [](const Term& lhs, const Term& rhs) { return Compare(lhs, rhs) < 0; });
+
+    // ax + bx -> (a+b)x, dropping 0x
+    size_t count = 0;
+
+    for (auto& term : terms)
+    {
+        if (count > 0 && Compare(terms[count - 1], term) == 0)
+            terms[count - 1].coefficient += term.coefficient;
+        else if (&terms[count] != &term)
+            terms[count++] = std::move(term);
+        else
+            count++;
+    }
+
+    terms.resize(count);
+    terms.erase(std::remove_if(terms.begin(), terms.end(), [](const Term& term) { return term.coefficient == 0; }), terms.end());
+}
+
+std::unique_ptr<ExpressionBase> RewriteEngine::BuildSum(std::vector<Term>& terms)
+{
+    if (terms.empty())
+        return std::make_unique<Constant>(0);
+
+    auto sum = BuildProduct(terms[0]);
+
+    // Later terms are added or subtracted so that only the first can print with a leading minus
+    for (size_t i = 1; i < terms.size(); i++)
+    {
+        if (terms[i].coefficient < 0)
+        {
+            terms[i].coefficient = -terms[i].coefficient;
+            sum = std::make_unique<OperatorMinus>(std::move(sum), BuildProduct(terms[i]));
+        }
+        else
+        {
+            sum = std::make_unique<OperatorPlus>(std::move(sum), BuildProduct(terms[i]));
+        }
+    }
+
+    return sum;
+}
+
+std::unique_ptr<ExpressionBase> RewriteEngine::BuildProduct(Term& term)
+{
+    auto coefficient = term.coefficient;
+
+    if (coefficient == 0)
+        return std::make_unique<Constant>(0);
+
+    auto Power = [](Factor& factor, double exponent) -> std::unique_ptr<ExpressionBase>
+    {
+        if (exponent == 1)
+            return std::move(factor.base);
+
+        return std::make_unique<OperatorExponent>(std::move(factor.base), std::make_unique<Constant>(exponent));
+    };
+
+    auto AppendTo = [](std::unique_ptr<ExpressionBase>& product, std::unique_ptr<ExpressionBase> factor)
+    {
+        if (product)
+            product = std::make_unique<OperatorMultiply>(std::move(product), std::move(factor));
+        else
+            product = std::move(factor);
+    };
+
+    // Negative exponents make up the denominator: 3x^-2 -> 3/x^2
+    bool hasNumerator = std::any_of(term.factors.begin(), term.factors.end(), [](const Factor& factor) { return factor.exponent > 0; });
+
+    // A coefficient of -1 negates the first factor rather than printing as -1x
+    bool negate = hasNumerator && coefficient == -1;
+
+    std::unique_ptr<ExpressionBase> numerator;
+    std::unique_ptr<ExpressionBase> denominator;
+
+    if (!hasNumerator || (coefficient != 1 && !negate))
+        numerator = std::make_unique<Constant>(coefficient);
+
+    for (auto& factor : term.factors)
+    {
+        if (factor.exponent < 0) continue;
+
+        auto power = Power(factor, factor.exponent);
+
+        if (negate)
+        {
+            power = std::make_unique<OperatorUnaryMinus>(std::move(power));
+            negate = false;
+        }
+
+        AppendTo(numerator, std::move(power));
+    }
+
+    for (auto& factor : term.factors)
+    {
+        if (factor.exponent < 0)
+            AppendTo(denominator, Power(factor, -factor.exponent));
+    }
+
+    if (denominator)
+        return std::make_unique<OperatorDivide>(std::move(numerator), std::move(denominator));
+
+    return numerator;
+}
+
+int RewriteEngine::Compare(ExpressionBase& lhs, ExpressionBase& rhs)
+{
+    auto l = OperandsOf(lhs);
+    auto r = OperandsOf(rhs);
+
+    if (auto byRank = CompareValues(Rank(l.kind), Rank(r.kind)))
+        return byRank;
+
+    if (l.kind == Kind::Constant)
+        return CompareValues(static_cast<Constant&>(lhs).GetConstant(), static_cast<Constant&>(rhs).GetConstant());
+
+    if (l.kind == Kind::Variable)
+        return CompareValues(static_cast<Variable&>(lhs).GetVariable(), static_cast<Variable&>(rhs).GetVariable());
+
+    if (l.left)
+    {
+        if (auto byLeft = Compare(**l.left, **r.left))
+            return byLeft;
+    }
+
+    return Compare(**l.right, **r.right);
+}
+
+int RewriteEngine::Compare(const Term& lhs, const Term& rhs)
+{
+    // By factor, and higher powers first, so polynomials come out in descending order and the
+    // constant term last
+    auto count = std::min(lhs.factors.size(), rhs.factors.size());
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (auto byBase = Compare(*lhs.factors[i].base, *rhs.factors[i].base))
+            return byBase;
+
+        if (auto byExponent = CompareValues(rhs.factors[i].exponent, lhs.factors[i].exponent))
+            return byExponent;
+    }
+
+    return CompareValues(rhs.factors.size(), lhs.factors.size());
+}
+
+RewriteEngine::Operands RewriteEngine::OperandsOf(ExpressionBase& node)
+{
+    auto Binary = [](auto& node) { return Operands{ node.Kind(), &node.left, &node.right }; };
+
+    switch (node.Kind())
+    {
+    case Kind::Plus: return Binary(static_cast<OperatorPlus&>(node));
+    case Kind::Minus: return Binary(static_cast<OperatorMinus&>(node));
+    case Kind::Multiply: return Binary(static_cast<OperatorMultiply&>(node));
+    case Kind::Divide: return Binary(static_cast<OperatorDivide&>(node));
+    case Kind::Exponent: return Binary(static_cast<OperatorExponent&>(node));
+    case Kind::UnaryMinus: return Operands{ Kind::UnaryMinus, nullptr, &static_cast<OperatorUnaryMinus&>(node).right };
+    default: return Operands{ node.Kind(), nullptr, nullptr };
+    }
+}
+
+std::string RewriteEngine::RuleName(Rule rule)
+{
+    switch (rule)
+    {
+    case Rule::CollectTerms: return "CollectTerms";
+    case Rule::CollectFactors: return "CollectFactors";
+    case Rule::PowerOfOne: return "PowerOfOne";
+    case Rule::ExponentOne: return "ExponentOne";
+    case Rule::EvaluateConstant: return "EvaluateConstant";
+    default: return "Unknown";
+    }
+}
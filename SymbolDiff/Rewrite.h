@@ -0,0 +1,98 @@
+#pragma once
+#include "Expression.h"
+
+#include <array>
+#include <string>
+#include <vector>
+
+// Simplifies an expression in place by applying a table of local rewrite rules. The tree is
+// walked once bottom-up, and at every node the rules for its type are applied until none match,
+// so the node's children are always already simplified. As every rule leaves its node in final
+// form given simplified children, the single walk reaches the fixed point. Rewriting stops early
+// if the budget of rule applications runs out, in which case the expression is still correct,
+// just less simplified.
+//
+// Sums and products are kept in a canonical form: a chain of + and - (or * and /) is flattened
+// into a list of terms (or factors), like terms and powers of equal bases are merged, and the
+// list is sorted and rebuilt as a chain of binary operators. A chain is only collected from its
+// topmost node, which also collects the products that are its terms and the powers that are its
+// factors.
+
+class RewriteEngine
+{
+public:
+	enum class Rule
+	{
+		CollectTerms,			// Sums: 2x+y+3x-1+1 -> 5x+y, x-x -> 0, -(x-y) -> -x+y
+		CollectFactors,			// Products and powers: x*3*x/y -> 3x^2/y, x^2/x -> x, 2(x+1) -> 2x+2, (2x)^2 -> 4x^2
+		PowerOfOne,				// 1^x -> 1
+		ExponentOne,			// x^1 -> x
+		EvaluateConstant,		// An operator whose operands are all constants -> its value
+		Count,
+	};
+
+	struct Statistics
+	{
+		size_t visits = 0;
+		size_t applications = 0;
+		bool budgetExhausted = false;
+		std::array<size_t, static_cast<size_t>(Rule::Count)> applicationsPerRule = {};
+	};
+
+	static constexpr size_t defaultBudget = 1 << 20;
+
+	explicit RewriteEngine(size_t budget = defaultBudget) : budget(budget) {}
+
+	std::unique_ptr<ExpressionBase> Rewrite(std::unique_ptr<ExpressionBase> expr);
+
+	const Statistics& GetStatistics() const { return statistics; }
+
+	static std::string RuleName(Rule rule);
+
+private:
+	struct Operands
+	{
+		ExpressionKind kind;
+		std::unique_ptr<ExpressionBase>* left;
+		std::unique_ptr<ExpressionBase>* right;
+	};
+
+	// base^exponent
+	struct Factor
+	{
+		std::unique_ptr<ExpressionBase> base;
+		double exponent;
+	};
+
+	// coefficient * factors, the factors are empty for a constant term
+	struct Term
+	{
+		double coefficient;
+		std::vector<Factor> factors;
+	};
+
+	static Operands OperandsOf(ExpressionBase& node);
+
+	// Total order on expressions, 0 if and only if they are equal
+	static int Compare(ExpressionBase& lhs, ExpressionBase& rhs);
+	static int Compare(const Term& lhs, const Term& rhs);
+
+	// Both move the operands out of the chain, leaving it to be destroyed
+	static void FlattenSum(std::unique_ptr<ExpressionBase>& node, double scale, std::vector<Term>& terms);
+	static void FlattenProduct(std::unique_ptr<ExpressionBase>& node, double exponent, Term& term);
+
+	static void CollectFactors(Term& term);
+	static void CollectTerms(std::vector<Term>& terms);
+
+	static std::unique_ptr<ExpressionBase> BuildSum(std::vector<Term>& terms);
+	static std::unique_ptr<ExpressionBase> BuildProduct(Term& term);
+
+	// parent is nullopt at the root
+	void Pass(std::unique_ptr<ExpressionBase>& node, std::optional<ExpressionKind> parent);
+	// Collecting is skipped for nodes that an ancestor will collect
+	void ApplyRules(std::unique_ptr<ExpressionBase>& node, bool collect);
+	bool TryRule(Rule rule, std::unique_ptr<ExpressionBase>& node, const Operands& operands);
+
+	size_t budget;
+	Statistics statistics;
+};
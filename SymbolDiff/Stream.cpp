@@ -0,0 +1,185 @@
+#include "Stream.h"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    // Blocks producers while full and consumers while empty, so a fast stage can't run
+    // arbitrarily far ahead of a slow one and hold the whole input in memory
+    template <typename T>
+    class BoundedQueue
+    {
+    public:
+        explicit BoundedQueue(size_t capacity) : capacity(capacity) {}
+
+        // Returns false, dropping item, once the queue is closed
+        bool Push(T item)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            notFull.wait(lock, [this] { return closed || items.size() < capacity; });
+
+            if (closed) return false;
+
+            items.push_back(std::move(item));
+            notEmpty.notify_one();
+
+            return true;
+        }
+
+        // Returns nullopt once the queue is closed and drained
+        std::optional<T> Pop()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            notEmpty.wait(lock, [this] { return closed || !items.empty(); });
+
+            if (items.empty()) return std::nullopt;
+
+            T item = std::move(items.front());
+            items.pop_front();
+            notFull.notify_one();
+
+            return item;
+        }
+
+        // Wakes every blocked producer and consumer, so either side can close to stop the other
+        void Close()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+            notEmpty.notify_all();
+            notFull.notify_all();
+        }
+
+    private:
+        std::deque<T> items;
+        size_t capacity;
+        bool closed = false;
+        std::mutex mutex;
+        std::condition_variable notEmpty;
+        std::condition_variable notFull;
+    };
+
+    // Enough batches in flight for each stage to always have the next one ready
+    constexpr size_t queueCapacity = 4;
+}
+
+StreamStatistics DifferentiateStream(std::istream& in, std::ostream& out, char wrt, size_t batchSize, OutputFormat format)
+{
+    if (batchSize == 0) batchSize = 1;
+
+    BoundedQueue<std::vector<std::string>> lines(queueCapacity);
+    BoundedQueue<std::string> text(queueCapacity);
+
+    // Whichever stage fails first closes the queues it shares, which stops the others, and
+    // its exception is rethrown once every thread has been joined
+    std::exception_ptr readerError, writerError, error;
+
+    std::thread reader([&]
+    {
+        try
+        {
+            std::vector<std::string> batch;
+            std::string line;
+
+            while (std::getline(in, line))
+            {
+                // Tolerate files with Windows line endings
+                if (!line.empty() && line.back() == '\r')
+                    line.pop_back();
+
+                batch.push_back(std::move(line));
+
+                if (batch.size() == batchSize)
+                {
+                    if (!lines.Push(std::move(batch))) break;
+                    batch.clear();
+                }
+            }
+
+            if (!batch.empty())
+                lines.Push(std::move(batch));
+        }
+        catch (...)
+        {
+            readerError = std::current_exception();
+        }
+
+        lines.Close();
+    });
+
+    std::thread writer;
+    StreamStatistics statistics;
+
+    try
+    {
+        // One write per batch, rather than one per line
+        writer = std::thread([&]
+        {
+            try
+            {
+                while (auto chunk = text.Pop())
+                    out.write(chunk->data(), static_cast<std::streamsize>(chunk->size()));
+
+                out.flush();
+            }
+            catch (...)
+            {
+                writerError = std::current_exception();
+            }
+
+            text.Close();
+        });
+
+        while (auto batch = lines.Pop())
+        {
+            auto results = DifferentiateBatch(*batch, wrt, format);
+            std::string chunk;
+
+            for (const auto& result : results)
+            {
+                if (result.error.empty())
+                {
+                    chunk += result.derivative;
+                }
+                else
+                {
+                    chunk += "Error: ";
+                    chunk += result.error;
+                    statistics.errors++;
+                }
+
+                chunk += '\n';
+            }
+
+            statistics.expressions += results.size();
+
+            if (!text.Push(std::move(chunk))) break;
+        }
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+
+    // The writer still writes out everything it was given
+    lines.Close();
+    text.Close();
+
+    reader.join();
+
+    if (writer.joinable())
+        writer.join();
+
+    for (const auto& stageError : { error, readerError, writerError })
+        if (stageError)
+            std::rethrow_exception(stageError);
+
+    return statistics;
+}
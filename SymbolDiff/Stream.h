@@ -0,0 +1,19 @@
+#pragma once
+#include "Algorithms.h"
+
+#include <cstddef>
+#include <istream>
+#include <ostream>
+
+struct StreamStatistics
+{
+	size_t expressions = 0;
+	size_t errors = 0;
+};
+
+// Differentiates newline delimited expressions from in, writing one line per expression to
+// out in the same order: the derivative, or "Error: " and the message. Reading, differentiating
+// and writing run as separate pipeline stages over batches of lines, with the differentiating
+// stage spread across the default thread pool by DifferentiateBatch. If any stage throws, the
+// others stop and the exception is rethrown once they have all finished.
+StreamStatistics DifferentiateStream(std::istream& in, std::ostream& out, char wrt, size_t batchSize = 4096, OutputFormat format = OutputFormat::Expression);
@@ -0,0 +1,158 @@
+#pragma once
+#include <cmath>
+#include <vector>
+
+// A truncated Taylor series along some direction, for Taylor mode differentiation. Coefficient k
+// is the kth derivative over k!, and both operands of an operation have the same number of them.
+
+struct Taylor
+{
+	std::vector<double> coefficients;
+
+	size_t Size() const { return coefficients.size(); }
+	double operator[](size_t k) const { return coefficients[k]; }
+	double& operator[](size_t k) { return coefficients[k]; }
+
+	// value, 0, 0, ...
+	static Taylor Constant(double value, size_t size)
+	{
+		Taylor result{ std::vector<double>(size, 0.0) };
+		result[0] = value;
+		return result;
+	}
+
+	// True if every coefficient past the value is 0
+	bool IsConstant() const
+	{
+		for (size_t k = 1; k < Size(); k++)
+			if (coefficients[k] != 0) return false;
+
+		return true;
+	}
+};
+
+inline Taylor operator+(Taylor l, const Taylor& r)
+{
+	for (size_t k = 0; k < l.Size(); k++)
+		l[k] += r[k];
+
+	return l;
+}
+
+inline Taylor operator-(Taylor l, const Taylor& r)
+{
+	for (size_t k = 0; k < l.Size(); k++)
+		l[k] -= r[k];
+
+	return l;
+}
+
+inline Taylor operator-(Taylor r)
+{
+	for (auto& coefficient : r.coefficients)
+		coefficient = -coefficient;
+
+	return r;
+}
+
+inline Taylor operator*(const Taylor& l, const Taylor& r)
+{
+	auto result = Taylor::Constant(0, l.Size());
+
+	for (size_t k = 0; k < l.Size(); k++)
+		for (size_t j = 0; j <= k; j++)
+			result[k] += l[j] * r[k - j];
+
+	return result;
+}
+
+inline Taylor operator/(const Taylor& l, const Taylor& r)
+{
+	// From l = q*r: q_k = (l_k - sum_{j=1..k} r_j q_{k-j}) / r_0
+	auto q = Taylor::Constant(0, l.Size());
+
+	for (size_t k = 0; k < l.Size(); k++)
+	{
+		double sum = l[k];
+
+		for (size_t j = 1; j <= k; j++)
+			sum -= r[j] * q[k - j];
+
+		q[k] = sum / r[0];
+	}
+
+	return q;
+}
+
+inline Taylor Exp(const Taylor& u)
+{
+	// From e' = u'e: e_k = sum_{j=1..k} j u_j e_{k-j} / k
+	auto e = Taylor::Constant(std::exp(u[0]), u.Size());
+
+	for (size_t k = 1; k < u.Size(); k++)
+	{
+		for (size_t j = 1; j <= k; j++)
+			e[k] += j * u[j] * e[k - j];
+
+		e[k] /= k;
+	}
+
+	return e;
+}
+
+inline Taylor Log(const Taylor& a)
+{
+	// From a l' = a': l_k = (a_k - sum_{j=1..k-1} j l_j a_{k-j} / k) / a_0
+	auto l = Taylor::Constant(std::log(a[0]), a.Size());
+
+	for (size_t k = 1; k < a.Size(); k++)
+	{
+		double sum = 0;
+
+		for (size_t j = 1; j < k; j++)
+			sum += j * l[j] * a[k - j];
+
+		l[k] = (a[k] - sum / k) / a[0];
+	}
+
+	return l;
+}
+
+inline Taylor Power(const Taylor& l, const Taylor& r)
+{
+	// A varying exponent goes through a^b = exp(b ln a), so like Power(Dual, Dual) a constant
+	// exponent never evaluates ln of a negative base
+	if (!r.IsConstant())
+		return Exp(r * Log(l));
+
+	const double exponent = r[0];
+
+	// The recurrence below divides by the base's value, so whole powers of a series through
+	// zero are multiplied out by squaring instead
+	if (l[0] == 0 && exponent >= 0 && exponent == std::floor(exponent))
+	{
+		auto result = Taylor::Constant(1, l.Size());
+		auto square = l;
+
+		for (auto n = exponent; n > 0; n = std::floor(n / 2))
+		{
+			if (std::fmod(n, 2) == 1) result = result * square;
+			if (n > 1) square = square * square;
+		}
+
+		return result;
+	}
+
+	// From a p' = r a' p: p_k = sum_{j=1..k} ((r+1) j - k) a_j p_{k-j} / (k a_0)
+	auto p = Taylor::Constant(std::pow(l[0], exponent), l.Size());
+
+	for (size_t k = 1; k < l.Size(); k++)
+	{
+		for (size_t j = 1; j <= k; j++)
+			p[k] += ((exponent + 1) * j - static_cast<double>(k)) * l[j] * p[k - j];
+
+		p[k] /= k * l[0];
+	}
+
+	return p;
+}
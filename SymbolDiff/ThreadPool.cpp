@@ -0,0 +1,227 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+
+ThreadPool::ThreadPool() :
+    ThreadPool(std::max(std::thread::hardware_concurrency(), 1u) - 1)
+{
+}
+
+ThreadPool::ThreadPool(size_t workers)
+{
+    threads.reserve(workers);
+
+    for (size_t i = 0; i < workers; i++)
+        threads.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+
+    available.notify_all();
+
+    for (auto& thread : threads)
+        thread.join();
+}
+
+void ThreadPool::WorkerLoop()
+{
+    for (;;)
+    {
+        std::function<void()> task;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            available.wait(lock, [this] { return stopping || !tasks.empty(); });
+
+            if (tasks.empty()) return;
+
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+
+        task();
+    }
+}
+
+namespace
+{
+    // A contiguous run of indices [begin, end) packed into one word, so that its owner taking
+    // from the front and thieves taking from the back can each be a single compare-and-swap
+    class IndexRange
+    {
+    public:
+        void Assign(uint64_t begin, uint64_t end)
+        {
+            bounds.store(begin << 32 | end);
+        }
+
+        bool PopFront(size_t& index)
+        {
+            auto current = bounds.load();
+
+            for (;;)
+            {
+                auto begin = current >> 32, end = current & 0xFFFFFFFF;
+                if (begin >= end) return false;
+
+                if (bounds.compare_exchange_weak(current, (begin + 1) << 32 | end))
+                {
+                    index = static_cast<size_t>(begin);
+                    return true;
+                }
+            }
+        }
+
+        // Takes the back half, rounded up
+        bool StealBack(uint64_t& stolenBegin, uint64_t& stolenEnd)
+        {
+            auto current = bounds.load();
+
+            for (;;)
+            {
+                auto begin = current >> 32, end = current & 0xFFFFFFFF;
+                if (begin >= end) return false;
+
+                auto middle = begin + (end - begin) / 2;
+
+                if (bounds.compare_exchange_weak(current, begin << 32 | middle))
+                {
+                    stolenBegin = middle;
+                    stolenEnd = end;
+                    return true;
+                }
+            }
+        }
+
+    private:
+        std::atomic<uint64_t> bounds{ 0 };
+    };
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& body)
+{
+    if (count == 0) return;
+
+    if (count > 0xFFFFFFFF)
+        throw std::length_error("ParallelFor supports at most 2^32 - 1 indices");
+
+    auto helpers = std::min(threads.size(), count - 1);
+
+    // Shared with the helper tasks, which may only get to run after this call has returned
+    struct State
+    {
+        std::function<void(size_t)> body;
+        std::unique_ptr<IndexRange[]> ranges;
+        size_t participants;
+        std::atomic<size_t> nextParticipant{ 0 };
+        std::atomic<bool> failed{ false };
+        size_t count;
+        size_t finished = 0;
+        std::exception_ptr exception;
+        std::mutex mutex;
+        std::condition_variable done;
+    };
+
+    auto state = std::make_shared<State>();
+    state->body = body;
+    state->count = count;
+    state->participants = helpers + 1;
+    state->ranges.reset(new IndexRange[state->participants]);
+
+    // Everyone starts with an equal share, and once that runs out steals half of what is
+    // left of someone else's, so uneven items still end up spread across all threads
+    for (size_t i = 0; i < state->participants; i++)
+        state->ranges[i].Assign(count * i / state->participants, count * (i + 1) / state->participants);
+
+    auto work = [state]
+    {
+        const auto self = state->nextParticipant.fetch_add(1);
+        auto& own = state->ranges[self];
+        size_t completed = 0;
+
+        auto next = [&](size_t& index)
+        {
+            if (own.PopFront(index)) return true;
+
+            for (size_t i = 1; i < state->participants; i++)
+            {
+                uint64_t begin, end;
+
+                if (state->ranges[(self + i) % state->participants].StealBack(begin, end))
+                {
+                    // Our range is empty, so no thief can be holding a stale view of it
+                    own.Assign(begin + 1, end);
+                    index = static_cast<size_t>(begin);
+                    return true;
+                }
+            }
+
+            return false;
+        };
+
+        for (size_t i; next(i); completed++)
+        {
+            if (state->failed) continue;
+
+            try
+            {
+                state->body(i);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+
+                if (!state->exception)
+                    state->exception = std::current_exception();
+
+                state->failed = true;
+            }
+        }
+
+        if (completed == 0) return;
+
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->finished += completed;
+
+        if (state->finished == state->count)
+            state->done.notify_all();
+    };
+
+    if (helpers > 0)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            for (size_t i = 0; i < helpers; i++)
+                tasks.emplace_back(work);
+        }
+
+        available.notify_all();
+    }
+
+    work();
+
+    // Wait for the indices other threads took, not for the helper tasks themselves, as those
+    // may still be queued behind work that is waiting on us
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->done.wait(lock, [&] { return state->finished == state->count; });
+
+    if (state->exception)
+        std::rethrow_exception(state->exception);
+}
+
+ThreadPool& ThreadPool::Default()
+{
+    static ThreadPool pool;
+    return pool;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads. ParallelFor is the only way work is handed out: the index
+// range is split between the calling thread and the workers, and whoever runs out of indices
+// steals from the others. The caller always takes part, so a ParallelFor issued from inside
+// another one (or on a pool with no workers) still completes.
+
+class ThreadPool
+{
+public:
+	// One worker per hardware thread, less the caller's
+	ThreadPool();
+	explicit ThreadPool(size_t workers);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Calls body(i) for every i in [0, count) and returns once all calls have finished. If a
+	// call throws, the remaining indices are skipped and the first exception is rethrown here.
+	void ParallelFor(size_t count, const std::function<void(size_t)>& body);
+
+	size_t Workers() const { return threads.size(); }
+
+	// A pool shared by the library, created on first use
+	static ThreadPool& Default();
+
+private:
+	void WorkerLoop();
+
+	std::vector<std::thread> threads;
+	std::deque<std::function<void()>> tasks;
+	std::mutex mutex;
+	std::condition_variable available;
+	bool stopping = false;
+};
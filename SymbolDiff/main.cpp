@@ -1,11 +1,63 @@
+#include <fstream>
 #include <iostream>
 
 #include "Algorithms.h"
-#include "Benchmark.h"
+#include "Stream.h"
 
-int main()
+// SymbolDiff --stream [file] [--wrt variable] [--cse]
+// Differentiates one expression per line of file (or stdin if omitted or '-') to stdout,
+// with --cse binding repeated subexpressions to temporaries
+int Stream(int argc, char* argv[])
 {
-	std::cout << "Benchmark: " << Benchmark(Differentiate, 100000, "(x+1)^2/(x-1)^2", 'x') << "ns\n";
+	std::string path = "-";
+	char wrt = 'x';
+	auto format = OutputFormat::Expression;
+
+	for (int i = 2; i < argc; i++)
+	{
+		std::string arg = argv[i];
+
+		if (arg == "--wrt" && i + 1 < argc && std::string(argv[i + 1]).size() == 1)
+			wrt = argv[++i][0];
+		else if (arg == "--cse")
+			format = OutputFormat::CommonSubexpressions;
+		else if (arg == "-" || arg[0] != '-')
+			path = arg;
+		else
+		{
+			std::cerr << "Usage: " << argv[0] << " --stream [file] [--wrt variable] [--cse]\n";
+			return 2;
+		}
+	}
+
+	std::ios::sync_with_stdio(false);
+
+	std::ifstream file;
+
+	if (path != "-")
+	{
+		file.open(path);
+
+		if (!file)
+		{
+			std::cerr << "Cannot open '" << path << "'\n";
+			return 1;
+		}
+	}
+
+	auto statistics = DifferentiateStream(path == "-" ? std::cin : file, std::cout, wrt, 4096, format);
+
+	std::cerr << statistics.expressions << " expressions, " << statistics.errors << " errors\n";
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc > 1 && std::string(argv[1]) == "--stream")
+		return Stream(argc, argv);
+
+	// SymbolDiff [--cse] runs interactively
+	auto format = argc > 1 && std::string(argv[1]) == "--cse" ? OutputFormat::CommonSubexpressions : OutputFormat::Expression;
 
 	std::string input;
 	
@@ -15,7 +67,7 @@ int main()
 
 		try
 		{
-			answer = Differentiate(input, 'x');
+			answer = Differentiate(input, 'x', format);
 		}
 		catch (const std::exception& e)
 		{
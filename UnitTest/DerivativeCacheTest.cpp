@@ -0,0 +1,106 @@
+#include "CppUnitTest.h"
+
+#include "..\SymbolDiff\Algorithms.h"
+#include "..\SymbolDiff\DerivativeCache.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Cache
+{
+	TEST_CLASS(structuralHash)
+	{
+	public:
+
+		TEST_METHOD(equalExpressions)
+		{
+			auto a = BuildExpression(Tokenize("3x^2+(x-1)/y"));
+			auto b = BuildExpression(Tokenize("3x^2+(x-1)/y"));
+
+			Assert::AreEqual(a->Hash(), b->Hash());
+			Assert::AreEqual(a->Hash(), a->Clone()->Hash());
+		}
+
+		TEST_METHOD(differentExpressions)
+		{
+			auto hash = BuildExpression(Tokenize("x-y"))->Hash();
+
+			Assert::AreNotEqual(hash, BuildExpression(Tokenize("y-x"))->Hash());
+			Assert::AreNotEqual(hash, BuildExpression(Tokenize("x+y"))->Hash());
+			Assert::AreNotEqual(hash, BuildExpression(Tokenize("x-z"))->Hash());
+		}
+
+		TEST_METHOD(updatedBySimplification)
+		{
+			// Simplified rewrites nodes in place, which must not leave stale hashes behind
+			auto simplified = BuildExpression(Tokenize("2+x+3"))->Simplified();
+
+			Assert::AreEqual(BuildExpression(Tokenize(simplified->Print()))->Hash(), simplified->Hash());
+		}
+	};
+
+	TEST_CLASS(derivativeCache)
+	{
+	public:
+
+		TEST_METHOD(matchesUncached)
+		{
+			for (auto input : { "3x^2+2x+1", "(x+1)^2/(x-1)^2", "(x+1)^2*(x+1)^2+(x+1)^2", "3(x^2+2)^5*(x^2+2)^3/(x^2+2)" })
+			{
+				auto expected = Differentiate(input, 'x');
+
+				DerivativeCache cache;
+				DerivativeCache::Scope scope(cache);
+
+				Assert::AreEqual(expected, Differentiate(input, 'x'));
+				Assert::AreEqual(expected, Differentiate(input, 'x'));
+			}
+		}
+
+		TEST_METHOD(repeatedSubexpressions)
+		{
+			DerivativeCache cache;
+			DerivativeCache::Scope scope(cache);
+
+			BuildExpression(Tokenize("(x+1)^2*(x+1)^2"))->Derivative('x');
+
+			Assert::IsTrue(cache.Hits() > 0);
+		}
+
+		TEST_METHOD(acrossCalls)
+		{
+			DerivativeCache cache;
+			DerivativeCache::Scope scope(cache);
+
+			Differentiate("(x+1)^2/(x-1)^2", 'x');
+			auto misses = cache.Misses();
+			auto hits = cache.Hits();
+
+			// The whole derivative and its simplification are found straight away
+			Differentiate("(x+1)^2/(x-1)^2", 'x');
+
+			Assert::AreEqual(misses, cache.Misses());
+			Assert::AreEqual(hits + 2, cache.Hits());
+		}
+
+		TEST_METHOD(keyedByVariable)
+		{
+			DerivativeCache cache;
+			DerivativeCache::Scope scope(cache);
+
+			Assert::AreEqual(std::string("2x"), Differentiate("x^2+y^2", 'x'));
+			Assert::AreEqual(std::string("2y"), Differentiate("x^2+y^2", 'y'));
+		}
+
+		TEST_METHOD(outlivesArena)
+		{
+			DerivativeCache cache;
+			DerivativeCache::Scope scope(cache);
+			ExpressionArena arena;
+
+			auto expected = Differentiate("(x+1)^2/(x-1)^2", 'x', arena);
+			arena.Reset();
+
+			Assert::AreEqual(expected, Differentiate("(x+1)^2/(x-1)^2", 'x', arena));
+		}
+	};
+}
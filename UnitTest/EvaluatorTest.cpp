@@ -0,0 +1,418 @@
+#include "CppUnitTest.h"
+
+#include "..\SymbolDiff\Algorithms.h"
+#include "..\SymbolDiff\BatchEvaluate.h"
+#include "..\SymbolDiff\DerivativeCache.h"
+#include "..\SymbolDiff\JitExpression.h"
+#include "..\SymbolDiff\Gradient.h"
+
+#include <thread>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Evaluator
+{
+	TEST_CLASS(compiledExpression)
+	{
+	public:
+
+		TEST_METHOD(matchesTreeEvaluate)
+		{
+			std::unordered_map<char, double> values = {
+				{ 'a', 2 },
+				{ 'b', 3 },
+				{ 'd', 8 },
+				{ 'e', 2 },
+				{ 'f', 1 },
+				{ 'x', 1.0 / 31.0 },
+				{ 'm', 0.5 },
+				{ 'n', 2 },
+			};
+
+			for (auto input : { "a^b^(32/d/e-f)^(x*31-m*n)", "3a(-x)^a", "-(b+c)", "(x+1)^2/(x-1)^2" })
+			{
+				auto expr = BuildExpression(Tokenize(input));
+				auto compiled = CompiledExpression::Compile(*expr);
+
+				auto expected = expr->Evaluate(values);
+				auto actual = compiled.Evaluate(values);
+
+				Assert::IsTrue(expected.has_value() == actual.has_value());
+				if (expected) Assert::AreEqual(*expected, *actual);
+			}
+		}
+
+		TEST_METHOD(denseSlots)
+		{
+			auto compiled = CompiledExpression::Compile(*BuildExpression(Tokenize("3ax^a")));
+
+			Assert::IsTrue(compiled.Variables() == std::vector<char>{ 'a', 'x' });
+
+			double slots[] = { 3, 2 };
+			Assert::AreEqual(72.0, compiled.Evaluate(slots));
+		}
+
+		TEST_METHOD(sharedSlotOrder)
+		{
+			auto compiled = CompiledExpression::Compile(*BuildExpression(Tokenize("x-y")), { 'y', 'x', 'z' });
+
+			double slots[] = { 1, 5, 100 };
+			Assert::AreEqual(4.0, compiled.Evaluate(slots));
+		}
+
+		TEST_METHOD(sharedSubexpressions)
+		{
+			auto expr = BuildExpression(Tokenize("(x+1)^2+(x+1)^2/(x+1)"));
+			auto compiled = CompiledExpression::Compile(*expr);
+
+			// x, 1, x+1, 2, (x+1)^2, /, + with each repeat computed once
+			Assert::AreEqual(size_t(7), compiled.Instructions().size());
+			Assert::AreEqual(*expr->Evaluate({ { 'x', 3 } }), *compiled.Evaluate({ { 'x', 3 } }));
+		}
+
+		TEST_METHOD(missingVariable)
+		{
+			auto compiled = CompiledExpression::Compile(*BuildExpression(Tokenize("x+y")));
+
+			Assert::IsFalse(compiled.Evaluate({ { 'x', 1 } }).has_value());
+
+			bool threwError = false;
+
+			try
+			{
+				CompiledExpression::Compile(*BuildExpression(Tokenize("x+y")), { 'x' });
+			}
+			catch (const std::invalid_argument&)
+			{
+				threwError = true;
+			}
+
+			Assert::IsTrue(threwError);
+		}
+	};
+
+	TEST_CLASS(batchEvaluate)
+	{
+	public:
+
+		TEST_METHOD(matchesScalarEvaluate)
+		{
+			// Not a multiple of the chunk or vector width, so every tail path is exercised
+			const size_t count = 1000 + 3;
+
+			for (auto input : { "3ax^a", "-(a+x)/(x-1)^2", "(x+1)^2/(x-1)^2-a*x", "2" })
+			{
+				auto expr = BuildExpression(Tokenize(input));
+				auto compiled = CompiledExpression::Compile(*expr, { 'a', 'x' });
+
+				std::vector<double> a(count), x(count), results(count);
+
+				for (size_t i = 0; i < count; i++)
+				{
+					a[i] = 0.5 + i * 0.001;
+					x[i] = -3.0 + i * 0.007;
+				}
+
+				const double* variables[] = { a.data(), x.data() };
+				EvaluateBatch(compiled, variables, results.data(), count);
+
+				for (size_t i = 0; i < count; i++)
+				{
+					auto expected = *expr->Evaluate({ { 'a', a[i] }, { 'x', x[i] } });
+
+					if (std::isnan(expected))
+						Assert::IsTrue(std::isnan(results[i]));
+					else
+						Assert::AreEqual(expected, results[i], 1e-9 * std::max(1.0, std::abs(expected)));
+				}
+			}
+		}
+	};
+
+	TEST_CLASS(jitExpression)
+	{
+	public:
+
+		TEST_METHOD(matchesInterpreter)
+		{
+			for (auto input : { "a^b^(32/d/e-f)^(x*31-m*n)", "3a(-x)^a", "-(b+c)", "(x+1)^2/(x-1)^2", "7" })
+			{
+				auto expr = BuildExpression(Tokenize(input));
+				auto compiled = CompiledExpression::Compile(*expr);
+				JitExpression jit(compiled);
+
+				Assert::IsTrue(!JitExpression::Supported() || jit.GetFunction() != nullptr);
+
+				std::vector<double> slots(compiled.Variables().size());
+
+				for (int i = 0; i < 10; i++)
+				{
+					for (size_t j = 0; j < slots.size(); j++)
+						slots[j] = 0.25 + i * 0.5 + j * 0.125;
+
+					auto expected = compiled.Evaluate(slots.data());
+					auto actual = jit(slots.data());
+
+					if (std::isnan(expected))
+						Assert::IsTrue(std::isnan(actual));
+					else
+						Assert::AreEqual(expected, actual);
+				}
+			}
+		}
+
+		TEST_METHOD(deepExpression)
+		{
+			// Enough registers to need 32 bit stack offsets
+			std::string input = "x";
+			for (int i = 0; i < 40; i++)
+				input = "(" + input + "+x)*0.5";
+
+			auto compiled = CompiledExpression::Compile(*BuildExpression(Tokenize(input)));
+			JitExpression jit(compiled);
+
+			double x = 3;
+			Assert::AreEqual(compiled.Evaluate(&x), jit(&x));
+		}
+	};
+
+	TEST_CLASS(gradient)
+	{
+	public:
+
+		TEST_METHOD(matchesSymbolicDerivatives)
+		{
+			std::unordered_map<char, double> values = { { 'a', 1.5 }, { 'x', 2.5 }, { 'y', -0.75 } };
+
+			for (auto input : { "3ax^5+y", "(x+1)^2/(x-1)^2", "-(a x y)/(x-y)^3", "3(x^2+a)^5" })
+			{
+				auto expr = BuildExpression(Tokenize(input));
+				auto actual = EvaluateGradient(*expr, values);
+
+				Assert::IsTrue(actual.has_value());
+				Assert::AreEqual(*expr->Evaluate(values), actual->value);
+
+				for (auto [variable, partial] : actual->partials)
+				{
+					auto expected = *expr->Derivative(variable)->Evaluate(values);
+					Assert::AreEqual(expected, partial, 1e-9 * std::max(1.0, std::abs(expected)));
+				}
+			}
+		}
+
+		TEST_METHOD(variableExponent)
+		{
+			// d/dx x^x = x^x (ln(x) + 1)
+			auto actual = EvaluateGradient(*BuildExpression(Tokenize("x^x")), { { 'x', 2 } });
+
+			Assert::AreEqual(4 * (std::log(2.0) + 1), actual->partials['x'], 1e-12);
+		}
+
+		TEST_METHOD(missingVariable)
+		{
+			Assert::IsFalse(EvaluateGradient(*BuildExpression(Tokenize("x+y")), { { 'x', 2 } }).has_value());
+		}
+	};
+
+	TEST_CLASS(dualNumbers)
+	{
+	public:
+
+		TEST_METHOD(matchesSymbolicDerivatives)
+		{
+			std::unordered_map<char, double> values = { { 'a', 1.5 }, { 'x', 2.5 }, { 'y', -0.75 } };
+
+			for (auto input : { "3ax^5+y", "(x+1)^2/(x-1)^2", "-(a x y)/(x-y)^3", "3(x^2+a)^5" })
+			{
+				auto expr = BuildExpression(Tokenize(input));
+
+				for (char wrt : { 'a', 'x', 'y', 'z' })
+				{
+					auto expected = *expr->Derivative(wrt)->Evaluate(values);
+					auto actual = DerivativeAt(*expr, wrt, values);
+
+					Assert::IsTrue(actual.has_value());
+					Assert::AreEqual(expected, *actual, 1e-9 * std::max(1.0, std::abs(expected)));
+				}
+			}
+		}
+
+		TEST_METHOD(directionalDerivative)
+		{
+			// Along (1, 2) the derivative of x^2 y is 2xy + 2x^2
+			auto expr = BuildExpression(Tokenize("x^2y"));
+			auto actual = expr->EvaluateDual({ { 'x', 3 }, { 'y', 5 } }, { { 'x', 1 }, { 'y', 2 } });
+
+			Assert::AreEqual(45.0, actual->value);
+			Assert::AreEqual(48.0, actual->tangent);
+		}
+
+		TEST_METHOD(variableExponent)
+		{
+			Assert::AreEqual(4 * (std::log(2.0) + 1), *DerivativeAt(*BuildExpression(Tokenize("x^x")), 'x', { { 'x', 2 } }), 1e-12);
+		}
+
+		TEST_METHOD(missingVariable)
+		{
+			Assert::IsFalse(DerivativeAt(*BuildExpression(Tokenize("x+y")), 'x', { { 'x', 2 } }).has_value());
+		}
+	};
+
+	TEST_CLASS(lazyDerivative)
+	{
+	public:
+
+		TEST_METHOD(evaluatesWithoutExpanding)
+		{
+			auto expr = BuildExpression(Tokenize("(x+1)^2/(x-1)^2*y"));
+			LazyDerivative lazy(expr->Clone(), 'x');
+
+			std::unordered_map<char, double> values = { { 'x', 2.5 }, { 'y', -0.75 } };
+			auto expected = *expr->Derivative('x')->Evaluate(values);
+
+			auto allocations = ExpressionArena::HeapAllocations();
+			auto actual = lazy.Evaluate(values);
+
+			Assert::AreEqual(allocations, ExpressionArena::HeapAllocations());
+			Assert::AreEqual(expected, *actual, 1e-9 * std::abs(expected));
+			Assert::IsFalse(lazy.Evaluate({ { 'x', 2.5 } }).has_value());
+		}
+
+		TEST_METHOD(expandsWhenForced)
+		{
+			auto expr = BuildExpression(Tokenize("(x+1)^2/(x-1)^2*y"));
+			auto eager = expr->Derivative('x');
+			auto lazy = std::make_unique<LazyDerivative>(expr->Clone(), 'x');
+
+			Assert::AreEqual(eager->Print(), lazy->Print());
+			Assert::AreEqual(eager->Simplified()->Print(), lazy->Simplified()->Print());
+
+			// As an operand it prints as its expansion would, and simplifying expands it in place
+			OperatorMultiply product(lazy->Clone(), std::make_unique<Constant>(3));
+			Assert::AreEqual("(" + eager->Print() + ")*3", product.Print());
+
+			OperatorMultiply simple(std::make_unique<LazyDerivative>(BuildExpression(Tokenize("x^2y")), 'x'), std::make_unique<Constant>(3));
+			Assert::AreEqual(std::string("6xy"), simple.Simplified()->Print());
+		}
+
+		TEST_METHOD(expandsOnTheHeap)
+		{
+			auto expr = BuildExpression(Tokenize("(x+1)^2/(x-1)^2*y"));
+			auto expected = expr->Derivative('x')->Print();
+			auto lazy = std::make_unique<LazyDerivative>(expr->Clone(), 'x');
+
+			{
+				ExpressionArena arena;
+				ExpressionArena::Scope scope(arena);
+
+				Assert::AreEqual(expected, lazy->Print());
+				Assert::AreEqual(size_t(0), arena.Allocations());
+			}
+
+			Assert::AreEqual(expected, lazy->Print());
+		}
+
+		TEST_METHOD(expandsOnce)
+		{
+			auto expr = BuildExpression(Tokenize("(x+1)^2/(x-1)^2*y"));
+			LazyDerivative lazy(expr->Clone(), 'x');
+			auto copy = lazy.Clone();
+
+			std::vector<const ExpressionBase*> expansions(8);
+			std::vector<std::thread> threads;
+
+			for (size_t i = 0; i < expansions.size(); i++)
+				threads.emplace_back([&, i] { expansions[i] = &(i % 2 ? lazy : static_cast<const LazyDerivative&>(*copy)).Expanded(); });
+
+			for (auto& thread : threads)
+				thread.join();
+
+			for (auto expansion : expansions)
+				Assert::IsTrue(expansion == expansions[0]);
+		}
+
+		TEST_METHOD(variableExponent)
+		{
+			// The symbolic rules only apply the power rule to a varying exponent, so the node
+			// evaluates its expansion rather than the operand's dual numbers
+			std::unordered_map<char, double> values = { { 'x', 2 } };
+
+			LazyDerivative lazy(BuildExpression(Tokenize("x^x")), 'x');
+			auto expected = *lazy.Expanded().Evaluate(values);
+
+			Assert::AreEqual(4.0, expected);
+			Assert::AreEqual(expected, *lazy.Evaluate(values));
+			Assert::AreEqual(expected, *CompiledExpression::Compile(lazy).Evaluate(values));
+
+			// Also when the varying exponent is nested in a deferred operand
+			auto expr = BuildExpression(Tokenize("(x+1)*x^x"));
+			auto deferred = LazyDerivativeOf(*expr, 'x');
+			Assert::AreEqual(*expr->Derivative('x')->Evaluate(values), *deferred->Evaluate(values));
+
+			// An exponent in another variable is a constant to the derivative
+			LazyDerivative other(BuildExpression(Tokenize("x^y")), 'x');
+			values['y'] = 3;
+			Assert::AreEqual(*other.Expanded().Evaluate(values), *other.Evaluate(values), 1e-12);
+		}
+
+		TEST_METHOD(lazyOperands)
+		{
+			auto expr = BuildExpression(Tokenize("(x+1)^2/(x-1)^2*y"));
+			auto eager = expr->Derivative('x');
+
+			auto allocations = ExpressionArena::HeapAllocations();
+			auto lazy = LazyDerivativeOf(*expr, 'x');
+			auto lazyAllocations = ExpressionArena::HeapAllocations() - allocations;
+
+			allocations = ExpressionArena::HeapAllocations();
+			expr->Derivative('x');
+			Assert::IsTrue(lazyAllocations < ExpressionArena::HeapAllocations() - allocations);
+
+			std::unordered_map<char, double> values = { { 'x', 2.5 }, { 'y', -0.75 } };
+			auto expected = *eager->Evaluate(values);
+			Assert::AreEqual(expected, *lazy->Evaluate(values), 1e-9 * std::abs(expected));
+
+			// Forcing it gives the eager derivative back
+			Assert::AreEqual(eager->Print(), lazy->Print());
+			Assert::AreEqual(eager->Simplified()->Print(), lazy->Simplified()->Print());
+
+			// Only leaves stay eager
+			auto product = LazyDerivativeOf(*BuildExpression(Tokenize("x(x+1)")), 'x');
+			const auto& sum = static_cast<const OperatorPlus&>(*product);
+			Assert::IsNotNull(ExpressionCast<LazyDerivative>(&static_cast<const OperatorMultiply&>(sum.GetLeft()).GetRight()));
+			Assert::IsNotNull(ExpressionCast<Constant>(&static_cast<const OperatorMultiply&>(sum.GetRight()).GetRight()));
+		}
+
+		TEST_METHOD(lazyOperandsBypassCache)
+		{
+			auto expr = BuildExpression(Tokenize("x(x+1)(x+2)"));
+
+			DerivativeCache cache;
+			DerivativeCache::Scope scope(cache);
+
+			auto lazy = LazyDerivativeOf(*expr, 'x');
+			auto eager = expr->Derivative('x');
+
+			const auto& sum = static_cast<const OperatorPlus&>(*eager);
+			Assert::IsNull(ExpressionCast<LazyDerivative>(&static_cast<const OperatorMultiply&>(sum.GetLeft()).GetRight()));
+			Assert::AreEqual(eager->Print(), lazy->Print());
+		}
+
+		TEST_METHOD(higherDerivatives)
+		{
+			auto expr = BuildExpression(Tokenize("(x+1)^2/(x-1)^2*y"));
+			LazyDerivative lazy(expr->Clone(), 'x');
+
+			std::unordered_map<char, double> values = { { 'x', 2.5 }, { 'y', -0.75 } };
+
+			auto expected = *expr->Derivative('x')->Derivative('y')->Evaluate(values);
+			auto actual = *lazy.Derivative('y')->Evaluate(values);
+			Assert::AreEqual(expected, actual, 1e-9 * std::abs(expected));
+
+			// Compiling differentiates within the DAG
+			expected = *expr->Derivative('x')->Evaluate(values);
+			actual = *CompiledExpression::Compile(lazy).Evaluate(values);
+			Assert::AreEqual(expected, actual, 1e-9 * std::abs(expected));
+		}
+	};
+}
@@ -0,0 +1,52 @@
+#include "CppUnitTest.h"
+
+#include "..\SymbolDiff\Algorithms.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Arena
+{
+	TEST_CLASS(expressionArena)
+	{
+	public:
+
+		TEST_METHOD(nodesAllocatedFromArena)
+		{
+			ExpressionArena arena;
+			auto heapAllocations = ExpressionArena::HeapAllocations();
+
+			{
+				ExpressionArena::Scope scope(arena);
+				auto expr = BuildExpression(Tokenize("3x^2+2x+1"))->Derivative('x');
+			}
+
+			Assert::AreEqual(heapAllocations, ExpressionArena::HeapAllocations());
+			Assert::IsTrue(arena.Allocations() > 0);
+
+			arena.Reset();
+			Assert::AreEqual(size_t(0), arena.Allocations());
+		}
+
+		TEST_METHOD(nestedScopes)
+		{
+			ExpressionArena outer;
+			ExpressionArena inner;
+
+			ExpressionArena::Scope outerScope(outer);
+			{
+				ExpressionArena::Scope innerScope(inner);
+				Assert::IsTrue(ExpressionArena::Current() == &inner);
+			}
+
+			Assert::IsTrue(ExpressionArena::Current() == &outer);
+		}
+
+		TEST_METHOD(differentiateMatchesHeap)
+		{
+			ExpressionArena arena(256);
+
+			for (auto input : { "3x^2+2x+1", "2ax^0.5", "1/x", "(x+1)^2/(x-1)^2" })
+				Assert::AreEqual(Differentiate(input, 'x'), Differentiate(input, 'x', arena));
+		}
+	};
+}
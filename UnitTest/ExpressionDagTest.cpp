@@ -0,0 +1,222 @@
+#include "CppUnitTest.h"
+
+#include "..\SymbolDiff\Algorithms.h"
+#include "..\SymbolDiff\ExpressionDag.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Dag
+{
+	TEST_CLASS(hashConsing)
+	{
+	public:
+
+		TEST_METHOD(identicalSubexpressionsShared)
+		{
+			ExpressionDag dag;
+
+			auto a = dag.Import(*BuildExpression(Tokenize("(x+1)^2")));
+			auto b = dag.Import(*BuildExpression(Tokenize("(x+1)^2")));
+
+			Assert::IsTrue(a == b);
+
+			// x, 1, x+1, 2, (x+1)^2
+			Assert::AreEqual(size_t(5), dag.Size());
+		}
+
+		TEST_METHOD(roundTrip)
+		{
+			auto expr = BuildExpression(Tokenize("a^b^(32/d/e-f)^(x*31-m*n)"));
+
+			ExpressionDag dag;
+			auto actual = dag.Export(dag.Import(*expr));
+
+			Assert::IsTrue(*actual == *expr);
+		}
+
+		TEST_METHOD(evaluate)
+		{
+			ExpressionDag dag;
+			auto id = dag.Import(*BuildExpression(Tokenize("3a(-x)^a")));
+
+			auto actual = dag.Evaluate(id, { {'x', 2}, {'a', 3} });
+
+			Assert::IsTrue(actual.has_value());
+			Assert::AreEqual(-72.0, *actual);
+			Assert::IsFalse(dag.Evaluate(id).has_value());
+		}
+	};
+
+	TEST_CLASS(derivative)
+	{
+	public:
+
+		TEST_METHOD(matchesTreeDerivative)
+		{
+			for (auto input : { "3x^5", "3(x^2+2)^5", "(x+1)/(x-1)", "-(3ax^a)/y" })
+			{
+				auto expr = BuildExpression(Tokenize(input));
+
+				ExpressionDag dag;
+				auto actual = dag.Export(dag.Derivative(dag.Import(*expr), 'x'));
+				auto expected = expr->Derivative('x')->Simplified();
+
+				Assert::IsTrue(ExpressionsNumericallyEqual(*expected, *actual));
+			}
+		}
+
+		TEST_METHOD(higherDerivativesShareNodes)
+		{
+			ExpressionDag dag;
+			auto id = dag.Import(*BuildExpression(Tokenize("(x+1)^2/(x-1)^2")));
+
+			std::vector<size_t> sizes;
+
+			for (int i = 0; i < 6; i++)
+			{
+				id = dag.Derivative(id, 'x');
+				sizes.push_back(dag.Size());
+			}
+
+			// The tree representation grows roughly tenfold with each derivative, while the
+			// memoized DAG only adds nodes for each distinct subexpression it differentiates.
+			// Pinned exactly, so losing any of the sharing shows up here.
+			const std::vector<size_t> expected = { 16, 30, 56, 91, 144, 229 };
+			Assert::IsTrue(expected == sizes);
+
+			auto tree = BuildExpression(Tokenize("(x+1)^2/(x-1)^2"));
+			for (int i = 0; i < 2; i++)
+				tree = tree->Derivative('x');
+
+			ExpressionDag second;
+			auto actual = second.Derivative(second.Derivative(second.Import(*BuildExpression(Tokenize("(x+1)^2/(x-1)^2"))), 'x'), 'x');
+
+			Assert::IsTrue(ExpressionsNumericallyEqual(*tree, *second.Export(actual)));
+		}
+	};
+
+	TEST_CLASS(higherOrder)
+	{
+	public:
+
+		TEST_METHOD(matchesRepeatedDerivative)
+		{
+			for (auto input : { "(x+1)^2/(x-1)^2", "3(x^2+2)^5y", "(x^2+y)^0.5*x" })
+			{
+				auto derivatives = Derivatives(*BuildExpression(Tokenize(input)), 'x', 4);
+				auto expected = BuildExpression(Tokenize(input));
+
+				Assert::AreEqual(size_t(4), derivatives.size());
+
+				for (const auto& actual : derivatives)
+				{
+					expected = expected->Derivative('x');
+					Assert::IsTrue(ExpressionsNumericallyEqual(*expected, *actual));
+				}
+			}
+		}
+
+		TEST_METHOD(polynomial)
+		{
+			std::vector<std::string> expected = { "3x^2+2x", "6x+2", "6", "0" };
+			Assert::IsTrue(expected == DifferentiateUpTo("x^3+x^2", 'x', 4));
+		}
+
+		TEST_METHOD(taylorCoefficients)
+		{
+			// 1/(1-x) = 1 + x + x^2 + ...
+			auto actual = TaylorCoefficients(*BuildExpression(Tokenize("1/(1-x)")), 'x', { { 'x', 0 } }, 5);
+			Assert::IsTrue(actual == std::vector<double>(6, 1.0));
+
+			// (x+1)^3 about x = 1 is 8 + 12(x-1) + 6(x-1)^2 + (x-1)^3
+			actual = TaylorCoefficients(*BuildExpression(Tokenize("(x+1)^3")), 'x', { { 'x', 1 } }, 4);
+			Assert::IsTrue(actual == std::vector<double>{ 8, 12, 6, 1, 0 });
+
+			// Whole powers of a series through zero, x^2 about x = 0
+			actual = TaylorCoefficients(*BuildExpression(Tokenize("x^2")), 'x', { { 'x', 0 } }, 3);
+			Assert::IsTrue(actual == std::vector<double>{ 0, 0, 1, 0 });
+
+			Assert::IsFalse(TaylorCoefficients(*BuildExpression(Tokenize("x+y")), 'x', { { 'x', 0 } }, 2).has_value());
+		}
+
+		TEST_METHOD(taylorMatchesDerivatives)
+		{
+			std::unordered_map<char, double> values = { { 'x', 0.7 }, { 'y', 1.3 } };
+
+			for (auto input : { "(x+1)^2/(x-1)^2", "(x^2+y)^0.5*x", "-(3yx^y)/(x+y)" })
+			{
+				auto expr = BuildExpression(Tokenize(input));
+				auto actual = TaylorCoefficients(*expr, 'x', values, 4);
+
+				Assert::IsTrue(actual.has_value());
+
+				double factorial = 1;
+
+				for (size_t k = 0; k <= 4; k++)
+				{
+					if (k > 0)
+					{
+						expr = expr->Derivative('x');
+						factorial *= k;
+					}
+
+					auto expected = *expr->Evaluate(values) / factorial;
+					Assert::AreEqual(expected, (*actual)[k], 1e-9 * (1 + std::abs(expected)));
+				}
+			}
+
+			// A varying exponent, which goes through exp and ln
+			auto actual = TaylorCoefficients(*BuildExpression(Tokenize("x^x")), 'x', values, 1);
+			Assert::AreEqual(*DerivativeAt(*BuildExpression(Tokenize("x^x")), 'x', values), (*actual)[1], 1e-12);
+		}
+	};
+
+	TEST_CLASS(temporaries)
+	{
+	public:
+
+		TEST_METHOD(nothingShared)
+		{
+			for (auto input : { "a^b^(32/d/e-f)^(x*31-m*n)", "3a(-x)^a", "-(b+c)", "(x+1)^2/(x-1)^2" })
+			{
+				auto expr = BuildExpression(Tokenize(input));
+				Assert::AreEqual(expr->Print(), PrintWithCommonSubexpressions(*expr));
+			}
+		}
+
+		TEST_METHOD(repeatedSubexpressions)
+		{
+			auto actual = PrintWithCommonSubexpressions(*BuildExpression(Tokenize("(x+1)^2-3(x+1)^2/(x+1)")));
+			Assert::AreEqual(std::string("t1 = x+1; t2 = t1^2; t2-3*t2/t1"), actual);
+
+			// t is a variable, so the temporaries take the first free letter
+			actual = PrintWithCommonSubexpressions(*BuildExpression(Tokenize("(a+t)(a+t)")));
+			Assert::AreEqual(std::string("b1 = a+t; b1*b1"), actual);
+		}
+
+		TEST_METHOD(juxtaposedSign)
+		{
+			std::string input = "x*-y(y+1)*-2";
+
+			Assert::AreEqual(input, PrintWithCommonSubexpressions(*BuildExpression(Tokenize(input))));
+		}
+
+		TEST_METHOD(negativeConstantBase)
+		{
+			auto actual = PrintWithCommonSubexpressions(OperatorExponent(std::make_unique<Constant>(-2), std::make_unique<Variable>('x')));
+			Assert::AreEqual(std::string("(-2)^x"), actual);
+
+			actual = PrintWithCommonSubexpressions(*BuildExpression(Tokenize("(x+y)*-2")));
+			Assert::AreEqual(std::string("(x+y)*-2"), actual);
+		}
+
+		TEST_METHOD(derivativeOutput)
+		{
+			auto actual = Differentiate("(x+1)^2/(x-1)^2", 'x', OutputFormat::CommonSubexpressions);
+			Assert::AreEqual(std::string("t1 = x-1; t2 = x+1; (-2*t2^2*t1+2*t2*t1^2)/t1^4"), actual);
+
+			// Polynomials print the same either way
+			Assert::AreEqual(Differentiate("3x^2+2x+1", 'x'), Differentiate("3x^2+2x+1", 'x', OutputFormat::CommonSubexpressions));
+		}
+	};
+}
@@ -0,0 +1,94 @@
+#include "CppUnitTest.h"
+
+#include "..\SymbolDiff\Algorithms.h"
+#include "..\SymbolDiff\Instrumentation.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Instrumented
+{
+	TEST_CLASS(instrumentation)
+	{
+	public:
+
+		TEST_METHOD(countsWork)
+		{
+			Instrumentation instrumentation;
+
+			{
+				Instrumentation::Scope scope(instrumentation);
+				Differentiate("(x+1)^2/(x-1)^2", 'x');
+			}
+
+			auto counters = instrumentation.Totals();
+
+			if (!Instrumentation::enabled)
+			{
+				Assert::AreEqual(size_t(0), counters.nodesAllocated);
+				Assert::AreEqual(size_t(0), counters.nodesCloned);
+				Assert::AreEqual(size_t(0), counters.simplifyPasses);
+				return;
+			}
+
+			// The quotient rule copies both operands
+			Assert::IsTrue(counters.nodesAllocated > counters.nodesCloned);
+			Assert::IsTrue(counters.nodesCloned > 0);
+			Assert::AreEqual(size_t(1), counters.simplifyPasses);
+		}
+
+		TEST_METHOD(onlyWhileScoped)
+		{
+			Instrumentation outer;
+			Instrumentation inner;
+
+			{
+				Instrumentation::Scope outerScope(outer);
+
+				{
+					Instrumentation::Scope innerScope(inner);
+					Differentiate("x^3/(x+1)", 'x');
+				}
+
+				Differentiate("1/x", 'x');
+			}
+
+			Differentiate("1/(x+2)", 'x');
+
+			// Each instrumentation only sees the one call made while it was innermost
+			Assert::AreEqual(size_t(Instrumentation::enabled ? 1 : 0), outer.Totals().simplifyPasses);
+			Assert::AreEqual(size_t(Instrumentation::enabled ? 1 : 0), inner.Totals().simplifyPasses);
+
+			outer.Reset();
+			Assert::AreEqual(size_t(0), outer.Totals().nodesAllocated);
+		}
+
+		TEST_METHOD(aggregatesBatch)
+		{
+			// Polynomials skip the simplifier, and input that fails to parse stops before it
+			const std::vector<std::string> inputs = { "3x^2+1", "(x+1)/(x-1)", "x^x", "2+", "1/x" };
+
+			Instrumentation instrumentation;
+			Instrumentation::Scope scope(instrumentation);
+
+			auto results = DifferentiateBatch(inputs, 'x');
+			auto totals = instrumentation.Totals();
+
+			Assert::AreEqual(size_t(Instrumentation::enabled ? 3 : 0), totals.simplifyPasses);
+
+#ifdef SYMBOLDIFF_INSTRUMENTATION
+			Instrumentation::Counters sum;
+
+			for (const auto& result : results)
+				sum += result.counters;
+
+			Assert::AreEqual(sum.nodesAllocated, totals.nodesAllocated);
+			Assert::AreEqual(sum.nodesCloned, totals.nodesCloned);
+
+			Assert::AreEqual(size_t(0), results[0].counters.simplifyPasses);
+			Assert::IsTrue(results[3].counters.nodesAllocated < results[1].counters.nodesAllocated);
+#else
+			Assert::AreEqual(size_t(0), totals.nodesAllocated);
+#endif
+		}
+	};
+}
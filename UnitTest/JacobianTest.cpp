@@ -0,0 +1,82 @@
+#include "CppUnitTest.h"
+
+#include "..\SymbolDiff\Algorithms.h"
+#include "..\SymbolDiff\Jacobian.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Jacobians
+{
+	std::vector<std::unique_ptr<ExpressionBase>> Parse(std::initializer_list<const char*> inputs)
+	{
+		std::vector<std::unique_ptr<ExpressionBase>> expressions;
+
+		for (auto input : inputs)
+			expressions.push_back(BuildExpression(Tokenize(input)));
+
+		return expressions;
+	}
+
+	TEST_CLASS(jacobian)
+	{
+	public:
+
+		TEST_METHOD(matchesDerivatives)
+		{
+			auto expressions = Parse({ "(x+y)^2/(x-z)", "3xy^2z", "(x+y)^2*z" });
+			std::vector<char> variables = { 'x', 'y', 'z' };
+
+			auto actual = Jacobian(expressions, variables);
+
+			Assert::AreEqual(expressions.size(), actual.size());
+
+			for (size_t i = 0; i < expressions.size(); i++)
+			{
+				for (size_t j = 0; j < variables.size(); j++)
+				{
+					auto expected = expressions[i]->Derivative(variables[j])->Simplified();
+
+					Assert::IsTrue(actual[i][j] != nullptr);
+					Assert::IsTrue(ExpressionsNumericallyEqual(*expected, *actual[i][j]));
+				}
+			}
+		}
+
+		TEST_METHOD(structuralZeros)
+		{
+			auto actual = Jacobian(Parse({ "x^2", "y+z", "3" }), { 'x', 'y', 'z' });
+
+			Assert::AreEqual(std::string("2x"), actual[0][0]->Print());
+			Assert::IsTrue(actual[0][1] == nullptr && actual[0][2] == nullptr);
+			Assert::IsTrue(actual[1][0] == nullptr);
+			Assert::AreEqual(std::string("1"), actual[1][1]->Print());
+			Assert::IsTrue(actual[2][0] == nullptr && actual[2][1] == nullptr && actual[2][2] == nullptr);
+		}
+
+		TEST_METHOD(hessian)
+		{
+			auto expr = BuildExpression(Tokenize("x^3y+(x+y)^2/(y-z)"));
+			std::vector<char> variables = { 'x', 'y', 'z' };
+
+			auto actual = Hessian(*expr, variables);
+
+			for (size_t j = 0; j < variables.size(); j++)
+			{
+				for (size_t k = 0; k < variables.size(); k++)
+				{
+					auto expected = expr->Derivative(variables[j])->Derivative(variables[k])->Simplified();
+
+					Assert::IsTrue(actual[j][k] != nullptr);
+					Assert::IsTrue(ExpressionsNumericallyEqual(*expected, *actual[j][k]));
+					Assert::IsTrue(*actual[j][k] == *actual[k][j]);
+				}
+			}
+
+			// x^2 only depends on x, so every other second derivative is a structural zero
+			actual = Hessian(*BuildExpression(Tokenize("x^2+y")), { 'x', 'y' });
+
+			Assert::AreEqual(std::string("2"), actual[0][0]->Print());
+			Assert::IsTrue(actual[0][1] == nullptr && actual[1][0] == nullptr && actual[1][1] == nullptr);
+		}
+	};
+}
@@ -108,5 +108,73 @@ namespace Lexer
 			Assert::IsTrue(actual == expected);
 		}
 
+		TEST_METHOD(DecimalConstants)
+		{
+			auto actual = Tokenize("0.25x^1.5");
+
+			decltype(actual) expected = {
+				Token::CreateConstant(0.25),
+				Token::CreateOperator('*'),
+				Token::CreateVariable('x'),
+				Token::CreateOperator('^'),
+				Token::CreateConstant(1.5)
+			};
+
+			Assert::IsTrue(actual == expected);
+		}
+
+		TEST_METHOD(ImplicitMultiplication)
+		{
+			auto actual = Tokenize("2(x)y(3)");
+
+			decltype(actual) expected = {
+				Token::CreateConstant(2),
+				Token::CreateOperator('*'),
+				Token::CreateOperator('('),
+				Token::CreateVariable('x'),
+				Token::CreateOperator(')'),
+				Token::CreateOperator('*'),
+				Token::CreateVariable('y'),
+				Token::CreateOperator('*'),
+				Token::CreateOperator('('),
+				Token::CreateConstant(3),
+				Token::CreateOperator(')')
+			};
+
+			Assert::IsTrue(actual == expected);
+		}
+
+		TEST_METHOD(InvalidTokens)
+		{
+			for (auto input : { "x$2", "1.2.3", "x+.5" })
+			{
+				bool threwError;
+
+				try
+				{
+					threwError = false;
+					Tokenize(input);
+				}
+				catch (const std::invalid_argument&)
+				{
+					threwError = true;
+				}
+
+				Assert::IsTrue(threwError);
+			}
+		}
+
+		TEST_METHOD(LongInput)
+		{
+			// Implicit multiplication used to be inserted into the middle of the vector, making this quadratic
+			std::string input;
+			for (int i = 0; i < 1000000; i++)
+				input += "x";
+
+			auto actual = Tokenize(input);
+
+			Assert::AreEqual(size_t(1999999), actual.size());
+			Assert::IsTrue(actual[1] == Token::CreateOperator('*'));
+		}
 	};
 }
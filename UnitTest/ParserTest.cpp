@@ -2,6 +2,9 @@
 
 #include "..\SymbolDiff\Algorithms.h"
 
+#include <cmath>
+#include <limits>
+
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
 namespace Parser
@@ -154,6 +157,22 @@ namespace Parser
 			Assert::IsTrue(*actual == *expected);
 		}
 
+		TEST_METHOD(nodeKinds)
+		{
+			auto actual = BuildExpression(Tokenize("3-x"));
+
+			Assert::IsTrue(actual->Kind() == ExpressionKind::Minus);
+			Assert::IsNotNull(ExpressionCast<OperatorMinus>(actual.get()));
+			Assert::IsNull(ExpressionCast<OperatorPlus>(actual.get()));
+
+			auto minus = ExpressionCast<OperatorMinus>(actual.get());
+			Assert::IsTrue(minus->GetLeft().Kind() == ExpressionKind::Constant);
+			Assert::IsTrue(minus->GetRight().Kind() == ExpressionKind::Variable);
+
+			// Copies keep their kind
+			Assert::IsTrue(actual->Clone()->Kind() == ExpressionKind::Minus);
+		}
+
 		TEST_METHOD(unary_minus)
 		{
 			auto actual = BuildExpression(Tokenize("-x"));
@@ -178,6 +197,37 @@ namespace Parser
 			Assert::IsTrue(*actual == *expected);
 		}
 
+		TEST_METHOD(unary_minus_precedence)
+		{
+			// Looser than ^, tighter than *
+			auto actual = BuildExpression(Tokenize("-x^2*y"));
+
+			decltype(actual) expected =
+				std::make_unique<OperatorMultiply>(
+					std::make_unique<OperatorUnaryMinus>(
+						std::make_unique<OperatorExponent>(
+							std::make_unique<Variable>('x'),
+							std::make_unique<Constant>(2))),
+					std::make_unique<Variable>('y'));
+
+			Assert::IsTrue(*actual == *expected);
+		}
+
+		TEST_METHOD(unary_minus_in_exponent)
+		{
+			auto actual = BuildExpression(Tokenize("2^-x*y"));
+
+			decltype(actual) expected =
+				std::make_unique<OperatorMultiply>(
+					std::make_unique<OperatorExponent>(
+						std::make_unique<Constant>(2),
+						std::make_unique<OperatorUnaryMinus>(
+							std::make_unique<Variable>('x'))),
+					std::make_unique<Variable>('y'));
+
+			Assert::IsTrue(*actual == *expected);
+		}
+
 		TEST_METHOD(invalid_expressions_1)
 		{
 			bool threwError;
@@ -279,6 +329,23 @@ namespace Parser
 
 			Assert::IsTrue(threwError);
 		}
+
+		TEST_METHOD(invalid_expressions_7)
+		{
+			bool threwError;
+
+			try
+			{
+				threwError = false;
+				BuildExpression(Tokenize("x+"));
+			}
+			catch (const std::invalid_argument&)
+			{
+				threwError = true;
+			}
+
+			Assert::IsTrue(threwError);
+		}
 	};
 
 	TEST_CLASS(expression_Print)
@@ -334,6 +401,67 @@ namespace Parser
 
 			Assert::AreEqual(expected, actual);
 		}
+
+		TEST_METHOD(juxtaposedNumbers)
+		{
+			std::string input = "x^2*3*2^x";
+
+			auto actual = BuildExpression(Tokenize(input))->Print();
+			decltype(actual) expected = input;
+
+			Assert::AreEqual(expected, actual);
+		}
+
+		TEST_METHOD(juxtaposedSign)
+		{
+			std::string input = "x*-y(y+1)*-2";
+
+			auto actual = BuildExpression(Tokenize(input))->Print();
+			decltype(actual) expected = input;
+
+			Assert::AreEqual(expected, actual);
+		}
+
+		TEST_METHOD(negativeConstantBase)
+		{
+			auto actual = OperatorExponent(std::make_unique<Constant>(-2), std::make_unique<Variable>('x')).Print();
+			decltype(actual) expected = "(-2)^x";
+
+			Assert::AreEqual(expected, actual);
+		}
+
+		TEST_METHOD(shortestRoundTrip)
+		{
+			auto actual = Constant(std::sqrt(3.0)).Print();
+			decltype(actual) expected = "1.7320508075688772";
+
+			Assert::AreEqual(expected, actual);
+			Assert::AreEqual(std::string("0.1"), Constant(0.1).Print());
+			Assert::AreEqual(std::sqrt(3.0), *BuildExpression(Tokenize(actual))->Evaluate());
+		}
+
+		TEST_METHOD(fixedNotation)
+		{
+			// The lexer doesn't read exponents, so neither is ever printed with one
+			Assert::AreEqual(std::string("0.0000001"), Constant(1e-7).Print());
+			Assert::AreEqual(std::string("100000000000000000000"), Constant(1e20).Print());
+
+			Assert::AreEqual(1e-7, *BuildExpression(Tokenize(Constant(1e-7).Print()))->Evaluate());
+			Assert::AreEqual(1e20, *BuildExpression(Tokenize(Constant(1e20).Print()))->Evaluate());
+		}
+
+		TEST_METHOD(negativeZero)
+		{
+			Assert::AreEqual(std::string("-0"), Constant(-0.0).Print());
+			Assert::AreEqual(std::string("x^(-0)"), OperatorExponent(std::make_unique<Variable>('x'), std::make_unique<Constant>(-0.0)).Print());
+		}
+
+		TEST_METHOD(infinityAndNan)
+		{
+			Assert::AreEqual(std::string("inf"), Constant(std::numeric_limits<double>::infinity()).Print());
+			Assert::AreEqual(std::string("-inf"), Constant(-std::numeric_limits<double>::infinity()).Print());
+			Assert::AreEqual(std::string("nan"), Constant(std::numeric_limits<double>::quiet_NaN()).Print());
+		}
 	};
 
 	TEST_CLASS(expression_evaluate)
@@ -443,6 +571,43 @@ namespace Parser
 
 			Assert::IsFalse(ExpressionsNumericallyEqual(*expected, *actual));
 		}
+
+		TEST_METHOD(tolerance)
+		{
+			auto actual = BuildExpression(Tokenize("100x"));
+			decltype(actual) expected = BuildExpression(Tokenize("101x"));
+
+			Assert::IsFalse(ExpressionsNumericallyEqual(*expected, *actual));
+			Assert::IsTrue(ExpressionsNumericallyEqual(*expected, *actual, { 1000, 0.01 }));
+		}
+
+		TEST_METHOD(differsInFewPoints)
+		{
+			// Only differ for x < -20, which a single repeated sample point would likely miss
+			auto actual = BuildExpression(Tokenize("x"));
+			decltype(actual) expected = BuildExpression(Tokenize("x+(x+20-((x+20)^2)^0.5)"));
+
+			Assert::IsFalse(ExpressionsNumericallyEqual(*expected, *actual));
+		}
+
+		TEST_METHOD(undefinedEverywhere)
+		{
+			// Neither side is real for any x, so no sample shows them equal
+			auto actual = BuildExpression(Tokenize("(-x^2-1)^0.5"));
+			decltype(actual) expected = BuildExpression(Tokenize("(-x^2-2)^0.5"));
+
+			Assert::IsFalse(ExpressionsNumericallyEqual(*expected, *actual));
+		}
+
+		TEST_METHOD(positionalOptions)
+		{
+			// Later fields go after seed, so initializers written against the first version keep their meaning
+			NumericEqualityOptions options{ 1000, 0.001, 7 };
+
+			Assert::AreEqual(7u, options.seed);
+			Assert::AreEqual(0.0, options.absoluteTolerance);
+			Assert::IsTrue(options.sameVariables);
+		}
 	};
 
 	TEST_CLASS(getSetOfAllSubVariables)
@@ -0,0 +1,104 @@
+#include "CppUnitTest.h"
+
+#include "..\SymbolDiff\Algorithms.h"
+#include "..\SymbolDiff\Polynomial.h"
+#include "..\SymbolDiff\Rewrite.h"
+
+#include <random>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Polynomials
+{
+	TEST_CLASS(polynomial)
+	{
+	public:
+
+		TEST_METHOD(detectsPolynomials)
+		{
+			for (auto input : { "3x^2+2x+1", "x*y^3-2y/4", "-(x-y)", "7", "x^0" })
+				Assert::IsTrue(Polynomial::FromExpression(*BuildExpression(Tokenize(input))).has_value());
+
+			for (auto input : { "x^y", "1/x", "x/0", "(x+1)^2", "x^-1", "x^0.5", "2(x+1)", "2^x" })
+				Assert::IsFalse(Polynomial::FromExpression(*BuildExpression(Tokenize(input))).has_value());
+		}
+
+		TEST_METHOD(collectsLikeTerms)
+		{
+			auto actual = Polynomial::FromExpression(*BuildExpression(Tokenize("x*y+y*x-2xy+3-x^2+x*x")));
+
+			Assert::AreEqual(size_t(1), actual->Terms());
+			Assert::AreEqual(std::string("3"), actual->Print());
+		}
+
+		TEST_METHOD(derivative)
+		{
+			auto actual = Polynomial::FromExpression(*BuildExpression(Tokenize("y^2+x^2*y+2xy+1")));
+
+			Assert::AreEqual(std::string("x^2y+2xy+y^2+1"), actual->Print());
+			Assert::AreEqual(std::string("2xy+2y"), actual->Derivative('x').Print());
+			Assert::AreEqual(std::string("x^2+2x+2y"), actual->Derivative('y').Print());
+			Assert::AreEqual(std::string("0"), actual->Derivative('z').Print());
+		}
+
+		TEST_METHOD(matchesGeneralPipeline)
+		{
+			for (auto input : { "3x^2+2x+1", "-x^3y+0.5y^2/3-x", "-(x-y)", "x^2z-z^2x+y-4", "-3", "x-x" })
+			{
+				auto expression = BuildExpression(Tokenize(input));
+
+				for (auto wrt : { 'x', 'y', 'z' })
+				{
+					auto expected = RewriteEngine().Rewrite(expression->Derivative(wrt))->Print();
+
+					Assert::AreEqual(expected, Polynomial::FromExpression(*expression)->Derivative(wrt).Print());
+				}
+			}
+		}
+
+		TEST_METHOD(matchesGeneralPipelineRandomly)
+		{
+			std::mt19937 random(0);
+			auto Below = [&random](unsigned n) { return static_cast<unsigned>(random() % n); };
+
+			for (size_t i = 0; i < 2000; i++)
+			{
+				// Whole coefficients and divisors, like terms and signs in every position
+				std::string input;
+				auto terms = 1 + Below(5);
+
+				for (unsigned term = 0; term < terms; term++)
+				{
+					if (term > 0) input += Below(2) ? "+" : "-";
+					if (Below(4) == 0) input += "-";
+
+					input += std::to_string(1 + Below(12));
+
+					for (auto variable : { 'x', 'y' })
+					{
+						auto power = Below(5);
+						if (power == 0) continue;
+
+						input += variable;
+						if (power > 1) input += "^" + std::to_string(power);
+					}
+
+					if (Below(2)) input += "/" + std::to_string(1 + Below(12));
+				}
+
+				auto expression = BuildExpression(Tokenize(input));
+				auto polynomial = Polynomial::FromExpression(*expression);
+
+				Assert::IsTrue(polynomial.has_value());
+
+				for (auto wrt : { 'x', 'y' })
+				{
+					auto expected = RewriteEngine().Rewrite(expression->Derivative(wrt))->Print();
+					auto message = std::wstring(input.begin(), input.end());
+
+					Assert::AreEqual(expected, polynomial->Derivative(wrt).Print(), message.c_str());
+				}
+			}
+		}
+	};
+}
@@ -0,0 +1,152 @@
+#include "CppUnitTest.h"
+
+#include "..\SymbolDiff\Algorithms.h"
+#include "..\SymbolDiff\DerivativeCache.h"
+#include "..\SymbolDiff\ExpressionDag.h"
+#include "..\SymbolDiff\RandomExpression.h"
+
+#include <cmath>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Random
+{
+	TEST_CLASS(randomExpression)
+	{
+	public:
+
+		TEST_METHOD(deterministic)
+		{
+			RandomExpressionOptions options;
+			options.variables = 3;
+
+			auto first = RandomExpression(options)->Print();
+			Assert::AreEqual(first, RandomExpression(options)->Print());
+
+			options.seed = 1;
+			Assert::AreNotEqual(first, RandomExpression(options)->Print());
+		}
+
+		TEST_METHOD(exactSize)
+		{
+			for (size_t size : { 1, 2, 3, 10, 257, 5000 })
+			{
+				RandomExpressionOptions options;
+				options.size = size;
+
+				ExpressionArena arena;
+				ExpressionArena::Scope scope(arena);
+
+				RandomExpression(options);
+				Assert::AreEqual(size, arena.Allocations());
+			}
+		}
+
+		TEST_METHOD(followsOptions)
+		{
+			RandomExpressionOptions options;
+			options.size = 200;
+			options.variables = 2;
+			options.minus = options.divide = options.exponent = options.unaryMinus = 0;
+
+			auto expr = RandomExpression(options);
+
+			Assert::IsTrue(expr->GetSetOfAllSubVariables() == std::unordered_set<char>{ 'x', 'y' });
+			Assert::AreEqual(std::string::npos, expr->Print().find_first_of("-/^"));
+
+			options.maxDepth = 0;
+			Assert::AreEqual(size_t(1), RandomExpression(options)->Print().size());
+
+			options.variables = 27;
+			bool threwError = false;
+
+			try
+			{
+				RandomExpression(options);
+			}
+			catch (const std::invalid_argument&)
+			{
+				threwError = true;
+			}
+
+			Assert::IsTrue(threwError);
+		}
+
+		TEST_METHOD(largeRoundTrip)
+		{
+			RandomExpressionOptions options;
+			options.size = 100000;
+			options.variables = 3;
+
+			auto text = RandomExpression(options)->Print();
+
+			Assert::AreEqual(text, BuildExpression(Tokenize(text))->Print());
+		}
+	};
+
+	// Checks the optimized paths against the plain tree algorithms on random expressions
+	TEST_CLASS(differential)
+	{
+	public:
+
+		TEST_METHOD(fastAndReferencePathsAgree)
+		{
+			NumericEqualityOptions equality;
+			equality.samples = 200;
+			// Simplifying may cancel a variable out, and a derivative that is 0 one way
+			// may be rounding error the other
+			equality.sameVariables = false;
+			equality.absoluteTolerance = 1e-6;
+
+			const std::unordered_map<char, double> probe = { { 'x', 0.7 }, { 'y', -1.3 } };
+			size_t tested = 0;
+
+			for (unsigned seed = 0; seed < 200; seed++)
+			{
+				RandomExpressionOptions options;
+				options.seed = seed;
+				options.size = 24;
+				options.variables = 2;
+
+				auto expr = RandomExpression(options);
+				auto reference = expr->Derivative('x');
+
+				// Dividing by something like x-x gives expressions that are undefined everywhere
+				auto value = expr->Evaluate(probe);
+				auto slope = reference->Evaluate(probe);
+				if (!value || !std::isfinite(*value) || !slope || !std::isfinite(*slope)) continue;
+
+				tested++;
+
+				const auto text = expr->Print();
+				const auto message = L"seed " + std::to_wstring(seed);
+
+				// Printing and parsing back
+				Assert::IsTrue(ExpressionsNumericallyEqual(*expr, *BuildExpression(Tokenize(text)), equality), message.c_str());
+
+				// Rewriting
+				Assert::IsTrue(ExpressionsNumericallyEqual(*expr, *expr->Simplified(), equality), message.c_str());
+
+				// The whole pipeline, with its polynomial shortcut and rewriting in place
+				auto derivative = Differentiate(text, 'x');
+				Assert::IsTrue(ExpressionsNumericallyEqual(*reference, *BuildExpression(Tokenize(derivative)), equality), message.c_str());
+
+				// Memoized
+				{
+					DerivativeCache cache;
+					DerivativeCache::Scope scope(cache);
+					Assert::AreEqual(derivative, Differentiate(text, 'x'));
+				}
+
+				// On a DAG, and to the second order
+				ExpressionDag dag;
+				auto id = dag.Import(*expr);
+				Assert::IsTrue(ExpressionsNumericallyEqual(*reference, *dag.Export(dag.Derivative(id, 'x')), equality), message.c_str());
+				Assert::IsTrue(ExpressionsNumericallyEqual(*reference->Derivative('x'), *Derivatives(*expr, 'x', 2)[1], equality), message.c_str());
+			}
+
+			// Nearly all are well defined
+			Assert::IsTrue(tested > 190);
+		}
+	};
+}
@@ -0,0 +1,100 @@
+#include "CppUnitTest.h"
+
+#include "..\SymbolDiff\Algorithms.h"
+#include "..\SymbolDiff\Rewrite.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Rewrite
+{
+	TEST_CLASS(rewriteEngine)
+	{
+	public:
+
+		TEST_METHOD(foldsConstantsAcrossChains)
+		{
+			RewriteEngine engine;
+			auto actual = engine.Rewrite(BuildExpression(Tokenize("2+(x+3)+4")));
+
+			Assert::AreEqual(std::string("x+9"), actual->Print());
+
+			// The whole chain is collected once, from its top
+			const auto& statistics = engine.GetStatistics();
+			Assert::AreEqual(size_t(1), statistics.applications);
+			Assert::AreEqual(size_t(1), statistics.applicationsPerRule[static_cast<size_t>(RewriteEngine::Rule::CollectTerms)]);
+		}
+
+		TEST_METHOD(collectsLikeTerms)
+		{
+			auto actual = RewriteEngine().Rewrite(BuildExpression(Tokenize("2x+y+3x-1+1-y+x*y-y*x")));
+
+			Assert::AreEqual(std::string("5x"), actual->Print());
+		}
+
+		TEST_METHOD(collectsPowers)
+		{
+			auto actual = RewriteEngine().Rewrite(BuildExpression(Tokenize("x*3*x/y*y^3/(-x)^3")));
+
+			Assert::AreEqual(std::string("-3y^2/x"), actual->Print());
+		}
+
+		TEST_METHOD(canonicalOrder)
+		{
+			// Sorted by variable then descending power, whatever order the terms came in
+			auto actual = RewriteEngine().Rewrite(BuildExpression(Tokenize("1+y^2+2(y*x)+x^2")));
+
+			Assert::AreEqual(std::string("x^2+2xy+y^2+1"), actual->Print());
+			Assert::IsTrue(*actual == *RewriteEngine().Rewrite(BuildExpression(Tokenize("x^2+1+y*y+x*2*y"))));
+		}
+
+		TEST_METHOD(reachesFixedPoint)
+		{
+			RewriteEngine engine;
+			auto actual = engine.Rewrite(BuildExpression(Tokenize("(x^(2-1)*1+0)*(3*y*0)+1^z")));
+
+			Assert::AreEqual(std::string("1"), actual->Print());
+			Assert::IsFalse(engine.GetStatistics().budgetExhausted);
+
+			// Running again finds nothing to do
+			RewriteEngine again;
+			again.Rewrite(std::move(actual));
+			Assert::AreEqual(size_t(0), again.GetStatistics().applications);
+		}
+
+		TEST_METHOD(budget)
+		{
+			auto input = BuildExpression(Tokenize("(x*1+0)*1+0"));
+
+			RewriteEngine engine(1);
+			auto actual = engine.Rewrite(input->Clone());
+
+			Assert::IsTrue(engine.GetStatistics().budgetExhausted);
+			Assert::AreEqual(size_t(1), engine.GetStatistics().applications);
+			Assert::IsTrue(ExpressionsNumericallyEqual(*input, *actual));
+		}
+
+		TEST_METHOD(matchesSimplified)
+		{
+			// The input, what the engine gives for its derivative, and what the recursive simplifier
+			// it replaced gave, which it must agree with numerically where it simplifies further
+			const char* const cases[][3] = {
+				{ "3x^2+2x+1", "6x+2", "6x+2" },
+				{ "(x+1)^2/(x-1)^2", "(-2(x+1)^2(x-1)+2(x+1)(x-1)^2)/(x-1)^4", "((x-1)^2(2(x+1))-(x+1)^2(2(x-1)))/((x-1)^2)^2" },
+				{ "3(x^2+2)^5", "30x(x^2+2)^4", "30(x(x^2+2)^4)" },
+				{ "-(2*3)x^(4-3)", "-6", "-6x^0" },
+			};
+
+			// x^0 -> 1 drops x
+			NumericEqualityOptions equality;
+			equality.sameVariables = false;
+
+			for (const auto& test : cases)
+			{
+				auto actual = RewriteEngine().Rewrite(BuildExpression(Tokenize(test[0]))->Derivative('x'));
+
+				Assert::AreEqual(std::string(test[1]), actual->Print());
+				Assert::IsTrue(ExpressionsNumericallyEqual(*BuildExpression(Tokenize(test[2])), *actual, equality));
+			}
+		}
+	};
+}
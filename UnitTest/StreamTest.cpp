@@ -0,0 +1,128 @@
+#include "CppUnitTest.h"
+
+#include "..\SymbolDiff\Algorithms.h"
+#include "..\SymbolDiff\Stream.h"
+
+#include <sstream>
+#include <stdexcept>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Streaming
+{
+	// Reads its text, then throws from whichever end runs out
+	class ThrowingBuffer : public std::streambuf
+	{
+	public:
+		explicit ThrowingBuffer(std::string text = {}) : text(std::move(text))
+		{
+			setg(&this->text[0], &this->text[0], &this->text[0] + this->text.size());
+		}
+
+	protected:
+		int_type underflow() override { throw std::runtime_error("Read failed"); }
+		int_type overflow(int_type) override { throw std::runtime_error("Write failed"); }
+
+	private:
+		std::string text;
+	};
+
+	TEST_CLASS(differentiateStream)
+	{
+	public:
+
+		TEST_METHOD(preservesOrder)
+		{
+			std::string input, expected;
+
+			for (int i = 0; i < 1000; i++)
+			{
+				auto line = std::to_string(i) + "x^2";
+				input += line + "\n";
+				expected += Differentiate(line, 'x') + "\n";
+			}
+
+			std::istringstream in(input);
+			std::ostringstream out;
+
+			// A batch size that doesn't divide the input, so the last batch is partial
+			auto statistics = DifferentiateStream(in, out, 'x', 64);
+
+			Assert::AreEqual(expected, out.str());
+			Assert::AreEqual(size_t(1000), statistics.expressions);
+			Assert::AreEqual(size_t(0), statistics.errors);
+		}
+
+		TEST_METHOD(errorsStayOnTheirLine)
+		{
+			std::istringstream in("x^2\r\ny++x\n\n3y");
+			std::ostringstream out;
+
+			auto statistics = DifferentiateStream(in, out, 'y');
+
+			std::istringstream lines(out.str());
+			std::vector<std::string> actual;
+
+			for (std::string line; std::getline(lines, line);)
+				actual.push_back(line);
+
+			Assert::AreEqual(size_t(4), actual.size());
+			Assert::AreEqual(std::string("0"), actual[0]);
+			Assert::IsTrue(actual[1].find("Error: ") == 0);
+			Assert::AreEqual(std::string("Error: Input cannot be empty"), actual[2]);
+			Assert::AreEqual(std::string("3"), actual[3]);
+			Assert::AreEqual(size_t(4), statistics.expressions);
+			Assert::AreEqual(size_t(2), statistics.errors);
+		}
+
+		TEST_METHOD(readerFailure)
+		{
+			ThrowingBuffer buffer("x^2\n3x\n");
+			std::istream in(&buffer);
+			in.exceptions(std::ios::badbit);
+
+			std::ostringstream out;
+			std::string error;
+
+			try
+			{
+				DifferentiateStream(in, out, 'x', 1);
+			}
+			catch (const std::exception& e)
+			{
+				error = e.what();
+			}
+
+			Assert::AreEqual(std::string("Read failed"), error);
+			// What was read before the failure is still written
+			Assert::AreEqual(std::string("2x\n3\n"), out.str());
+		}
+
+		TEST_METHOD(writerFailure)
+		{
+			std::string input;
+
+			for (int i = 0; i < 1000; i++)
+				input += "x^2\n";
+
+			std::istringstream in(input);
+			ThrowingBuffer buffer;
+			std::ostream out(&buffer);
+			out.exceptions(std::ios::badbit);
+
+			// The reader and differentiator must stop rather than fill the queues and wait forever
+			bool threwError = false;
+
+			try
+			{
+				DifferentiateStream(in, out, 'x', 1);
+			}
+			catch (const std::exception&)
+			{
+				threwError = true;
+			}
+
+			Assert::IsTrue(threwError);
+		}
+	};
+}
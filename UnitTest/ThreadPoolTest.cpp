@@ -0,0 +1,116 @@
+#include "CppUnitTest.h"
+
+#include "..\SymbolDiff\Algorithms.h"
+#include "..\SymbolDiff\ThreadPool.h"
+
+#include <atomic>
+#include <chrono>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Threading
+{
+	TEST_CLASS(threadPool)
+	{
+	public:
+
+		TEST_METHOD(visitsEveryIndexOnce)
+		{
+			ThreadPool pool(3);
+			std::vector<std::atomic<int>> visits(1000);
+
+			pool.ParallelFor(visits.size(), [&](size_t i) { visits[i]++; });
+
+			for (auto& count : visits)
+				Assert::AreEqual(1, count.load());
+		}
+
+		TEST_METHOD(unevenWork)
+		{
+			// All the slow items start out in one thread's share, the others have to steal them
+			ThreadPool pool(3);
+			std::vector<std::atomic<int>> visits(64);
+
+			pool.ParallelFor(visits.size(), [&](size_t i)
+			{
+				if (i < 16)
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+				visits[i]++;
+			});
+
+			for (auto& count : visits)
+				Assert::AreEqual(1, count.load());
+		}
+
+		TEST_METHOD(noWorkers)
+		{
+			ThreadPool pool(0);
+			size_t sum = 0;
+
+			pool.ParallelFor(10, [&](size_t i) { sum += i; });
+
+			Assert::AreEqual(size_t(45), sum);
+		}
+
+		TEST_METHOD(nested)
+		{
+			ThreadPool pool(2);
+			std::atomic<int> count{ 0 };
+
+			pool.ParallelFor(8, [&](size_t) { pool.ParallelFor(8, [&](size_t) { count++; }); });
+
+			Assert::AreEqual(64, count.load());
+		}
+
+		TEST_METHOD(rethrows)
+		{
+			ThreadPool pool(2);
+			bool threwError;
+
+			try
+			{
+				threwError = false;
+				pool.ParallelFor(100, [](size_t i) { if (i == 50) throw std::invalid_argument("failed"); });
+			}
+			catch (const std::invalid_argument&)
+			{
+				threwError = true;
+			}
+
+			Assert::IsTrue(threwError);
+		}
+	};
+
+	TEST_CLASS(differentiateBatch)
+	{
+	public:
+
+		TEST_METHOD(matchesDifferentiate)
+		{
+			std::vector<std::string> inputs;
+
+			for (int i = 0; i < 200; i++)
+				inputs.push_back(std::to_string(i) + "x^" + std::to_string(i % 7) + "+y");
+
+			auto results = DifferentiateBatch(inputs, 'x');
+
+			Assert::AreEqual(inputs.size(), results.size());
+
+			for (size_t i = 0; i < inputs.size(); i++)
+			{
+				Assert::AreEqual(Differentiate(inputs[i], 'x'), results[i].derivative);
+				Assert::IsTrue(results[i].error.empty());
+			}
+		}
+
+		TEST_METHOD(perItemErrors)
+		{
+			auto results = DifferentiateBatch({ "x^2", "y++x", "3x" }, 'x');
+
+			Assert::AreEqual(Differentiate("x^2", 'x'), results[0].derivative);
+			Assert::IsFalse(results[1].error.empty());
+			Assert::AreEqual(std::string("3"), results[2].derivative);
+		}
+	};
+}